@@ -0,0 +1,14 @@
+#include "band.h"
+
+uint8_t powerBand(bool onBattery, unsigned percent, unsigned lowPercent, uint8_t previous) {
+    if (!onBattery) {
+        return POWER_BAND_AC;
+    }
+    if (percent < lowPercent) {
+        return POWER_BAND_DC_LOW;
+    }
+    if (previous == POWER_BAND_DC_LOW && lowPercent > 0 && percent < lowPercent + POWER_BAND_HYSTERESIS) {
+        return POWER_BAND_DC_LOW;
+    }
+    return POWER_BAND_DC;
+}
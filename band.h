@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+// Power bands: plugged in, on battery, and on battery below the low battery
+// threshold. Only a change of band is applied, not every percent of drain.
+enum { POWER_BAND_AC = 0, POWER_BAND_DC, POWER_BAND_DC_LOW };
+
+// Percents the battery must be back above the low battery threshold to leave
+// POWER_BAND_DC_LOW, so that a reading hovering at the threshold does not
+// switch the bands back and forth.
+const unsigned POWER_BAND_HYSTERESIS = 2;
+
+// The band of the power supply: whether on battery, and the remaining
+// percentage. lowPercent is the low battery threshold, 0 if disabled.
+// previous is the band before, for the hysteresis.
+uint8_t powerBand(bool onBattery, unsigned percent, unsigned lowPercent, uint8_t previous);
@@ -31,4 +31,16 @@ rem compile resources.
 rc /nologo /fo %build_dir%\\res.res res.rc
 if errorlevel 1 exit
 
-cl /nologo /utf-8 %cl_flags% /D WINVER=0x0A00 /D _WIN32_WINNT=0x0A00  /D WIN32_LEAN_AND_MEAN *.cpp /link %link_flags% %build_dir%\\res.res User32.lib Shell32.lib Comctl32.lib Advapi32.lib PowrProf.lib Shlwapi.lib
\ No newline at end of file
+rem generate the string tables, the first locale is the default.
+if not exist %build_dir%\\strgen mkdir %build_dir%\\strgen
+cl /nologo /utf-8 /EHsc /Fe:"%build_dir%\\strgen.exe" /Fo"%build_dir%\\strgen\\" tools\\strgen.cpp tools\\fileio.cpp
+if errorlevel 1 exit
+%build_dir%\\strgen.exe res.h %build_dir%\\strtab.h en-US=str.rc zh-CN=str_zh-CN.rc
+if errorlevel 1 exit
+
+cl /nologo /utf-8 %cl_flags% /D WINVER=0x0A00 /D _WIN32_WINNT=0x0A00  /D WIN32_LEAN_AND_MEAN /I %build_dir% *.cpp /link %link_flags% %build_dir%\\res.res User32.lib Shell32.lib Comctl32.lib Advapi32.lib PowrProf.lib Shlwapi.lib Wtsapi32.lib Cfgmgr32.lib
+if errorlevel 1 exit
+
+rem compile the policy bundle compiler.
+if not exist %build_dir%\\policyc mkdir %build_dir%\\policyc
+cl /nologo /utf-8 /EHsc /I . /Fe:"%build_dir%\\policyc.exe" /Fo"%build_dir%\\policyc\\" tools\\policyc.cpp tools\\fileio.cpp policy.cpp schedule.cpp
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "deadline.h"
+
+using namespace std;
+
+deadlineTimer::deadlineTimer(UINT_PTR id, clockFunc clock)
+    : id(id), clock(clock), deadlines(), timerDeadline(0), wakeupCounts(), spuriousCount(0) {
+}
+
+DWORD deadlineTimer::arm(HWND hwnd, wakeupCause cause, DWORD delay) {
+    deadlines[cause] = clock() + delay;
+    return update(hwnd);
+}
+
+DWORD deadlineTimer::disarm(HWND hwnd, wakeupCause cause) {
+    deadlines[cause] = 0;
+    return update(hwnd);
+}
+
+bool deadlineTimer::armed(wakeupCause cause) const {
+    return deadlines[cause] != 0;
+}
+
+UINT deadlineTimer::expire(HWND hwnd) {
+    const ULONGLONG now = clock();
+    UINT due = 0;
+    for (int i = 0; i < WAKEUP_CAUSE_COUNT; i++) {
+        if (deadlines[i] != 0 && deadlines[i] <= now) {
+            deadlines[i] = 0;
+            wakeupCounts[i]++;
+            due |= 1 << i;
+        }
+    }
+    if (due == 0) {
+        spuriousCount++;
+    }
+    // The window timer is periodic. Kill it, and let update set it again if
+    // anything is still pending.
+    KillTimer(hwnd, id);
+    timerDeadline = 0;
+    update(hwnd);
+    return due;
+}
+
+UINT deadlineTimer::wakeups(wakeupCause cause) const {
+    return wakeupCounts[cause];
+}
+
+UINT deadlineTimer::spuriousWakeups() const {
+    return spuriousCount;
+}
+
+// Set the window timer to the earliest deadline, or kill it if none.
+DWORD deadlineTimer::update(HWND hwnd) {
+    ULONGLONG earliest = 0;
+    for (const auto deadline : deadlines) {
+        if (deadline != 0 && (earliest == 0 || deadline < earliest)) {
+            earliest = deadline;
+        }
+    }
+    if (earliest == timerDeadline) {
+        return ERROR_SUCCESS;
+    }
+    timerDeadline = earliest;
+    if (earliest == 0) {
+        KillTimer(hwnd, id);
+        return ERROR_SUCCESS;
+    }
+    const ULONGLONG now = clock();
+    UINT elapse = USER_TIMER_MINIMUM;
+    if (earliest > now) {
+        elapse = (UINT)min<ULONGLONG>(earliest - now, USER_TIMER_MAXIMUM);
+    }
+    // Let the system coalesce the wakeup with other timers.
+    if (!SetCoalescableTimer(hwnd, id, elapse, NULL, TIMERV_DEFAULT_COALESCING)) {
+        timerDeadline = 0;
+        return GetLastError();
+    }
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <windows.h>
+
+// Causes of timer wakeups.
+enum wakeupCause {
+    // Delayed processing of device change events.
+    WAKEUP_DEVICE_CHANGE = 0,
+    // Deferred writing of the config file.
+    WAKEUP_CONFIG_FLUSH,
+    // Transition of the time-of-day schedule.
+    WAKEUP_SCHEDULE,
+    // Retry of a display connectivity apply deferred by flap damping or rate
+    // limiting.
+    WAKEUP_RETRY,
+    // Delayed reload of the policy bundle after its directory changed.
+    WAKEUP_POLICY_CHANGE,
+    WAKEUP_CAUSE_COUNT
+};
+
+// Coalesces the timers of all wakeup causes into one window timer, which is
+// set to the earliest pending deadline. No timer is set while nothing is
+// pending, so an idle process never wakes up.
+class deadlineTimer {
+public:
+    typedef ULONGLONG(WINAPI *clockFunc)();
+
+    // id is the window timer id. clock returns the current time in
+    // milliseconds and can be replaced by a virtual clock.
+    deadlineTimer(UINT_PTR id, clockFunc clock = GetTickCount64);
+
+    // Expire cause delay milliseconds from now. A pending deadline of the
+    // same cause is replaced.
+    // Return value is the error code(ERROR_SUCCESS etc.).
+    DWORD arm(HWND hwnd, wakeupCause cause, DWORD delay);
+    // Cancel the pending deadline of cause.
+    DWORD disarm(HWND hwnd, wakeupCause cause);
+    // Whether cause has a pending deadline.
+    bool armed(wakeupCause cause) const;
+    // Process the WM_TIMER of the window timer.
+    // Returns the due causes as a bit mask of (1 << cause), which are counted
+    // as wakeups and disarmed.
+    UINT expire(HWND hwnd);
+
+    // Number of wakeups caused by cause.
+    UINT wakeups(wakeupCause cause) const;
+    // Number of window timer wakeups with no due cause.
+    UINT spuriousWakeups() const;
+
+private:
+    DWORD update(HWND hwnd);
+
+    const UINT_PTR id;
+    const clockFunc clock;
+    // Deadline of each cause, 0 if not armed.
+    ULONGLONG deadlines[WAKEUP_CAUSE_COUNT];
+    // Deadline the window timer is set to, 0 if not set.
+    ULONGLONG timerDeadline;
+    UINT wakeupCounts[WAKEUP_CAUSE_COUNT];
+    UINT spuriousCount;
+};
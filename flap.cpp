@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "flap.h"
+
+using namespace std;
+
+flapDetector::flapDetector(unsigned threshold, uint64_t window, uint64_t settle)
+    : threshold(min(max(threshold, 1u), (unsigned)MAX_THRESHOLD)), window(window), settle(settle),
+      transitions(), transitionCount(0), next(0), lastTransition(0),
+      observed(false), last(false), isFlapping(false), flapCount(0) {
+}
+
+bool flapDetector::update(bool connected, uint64_t now) {
+    if (observed && connected != last) {
+        lastTransition = now;
+        transitions[next] = now;
+        next = (next + 1) % threshold;
+        transitionCount = min(transitionCount + 1, threshold);
+        // transitions[next] is the oldest once the buffer is full.
+        if (!isFlapping && transitionCount == threshold && now - transitions[next] <= window) {
+            isFlapping = true;
+            flapCount++;
+        }
+    }
+    observed = true;
+    last = connected;
+    if (isFlapping && now >= settleTime()) {
+        isFlapping = false;
+        transitionCount = 0;
+    }
+    return isFlapping || connected;
+}
+
+tokenBucket::tokenBucket(unsigned capacity, uint64_t interval)
+    : capacity(capacity), interval(interval), tokens(capacity), lastRefill(0), started(false), denialCount(0) {
+}
+
+void tokenBucket::refill(uint64_t now) {
+    if (!started) {
+        started = true;
+        lastRefill = now;
+        return;
+    }
+    const uint64_t added = (now - lastRefill) / interval;
+    if (added == 0) {
+        return;
+    }
+    tokens = (unsigned)min<uint64_t>(capacity, tokens + added);
+    lastRefill = tokens == capacity ? now : lastRefill + added * interval;
+}
+
+bool tokenBucket::take(uint64_t now) {
+    refill(now);
+    if (tokens == 0) {
+        denialCount++;
+        return false;
+    }
+    tokens--;
+    return true;
+}
+
+uint64_t tokenBucket::wait(uint64_t now) {
+    refill(now);
+    if (tokens > 0) {
+        return 0;
+    }
+    return lastRefill + interval - now;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+
+// Hysteresis of a display link that may bounce between connected and
+// disconnected. After threshold transitions within window milliseconds the
+// link is flapping, and "connected", the safer state, is pinned until no
+// transition is seen for settle milliseconds.
+class flapDetector {
+public:
+    // threshold is at most MAX_THRESHOLD.
+    flapDetector(unsigned threshold, uint64_t window, uint64_t settle);
+    // Record the state observed at now(milliseconds).
+    // Returns the state to act on.
+    bool update(bool connected, uint64_t now);
+    bool flapping() const {
+        return isFlapping;
+    }
+    // When a flapping link settles if no more transition is seen.
+    uint64_t settleTime() const {
+        return lastTransition + settle;
+    }
+    // Number of times the link started flapping.
+    unsigned flaps() const {
+        return flapCount;
+    }
+
+    enum { MAX_THRESHOLD = 16 };
+
+private:
+    const unsigned threshold;
+    const uint64_t window;
+    const uint64_t settle;
+    // Times of the last threshold transitions, a ring buffer.
+    uint64_t transitions[MAX_THRESHOLD];
+    unsigned transitionCount;
+    unsigned next;
+    uint64_t lastTransition;
+    bool observed;
+    bool last;
+    bool isFlapping;
+    unsigned flapCount;
+};
+
+// Token bucket limiting the rate of an operation: up to capacity operations
+// in a burst, and one more every interval milliseconds.
+class tokenBucket {
+public:
+    tokenBucket(unsigned capacity, uint64_t interval);
+    // Take a token at now(milliseconds). Returns false if none is available.
+    bool take(uint64_t now);
+    // Milliseconds from now until a token is available.
+    uint64_t wait(uint64_t now);
+    // Number of times take failed.
+    unsigned denials() const {
+        return denialCount;
+    }
+
+private:
+    void refill(uint64_t now);
+
+    const unsigned capacity;
+    const uint64_t interval;
+    unsigned tokens;
+    uint64_t lastRefill;
+    bool started;
+    unsigned denialCount;
+};
@@ -4,23 +4,41 @@
 #include <strsafe.h>
 #include <shellapi.h>
 #include <shlwapi.h>
+#include <wtsapi32.h>
+#include <psapi.h>
 
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <set>
 #include <array>
-#include <map>
+#include <atomic>
+#include <memory>
 
+#include "band.h"
+#include "deadline.h"
+#include "flap.h"
 #include "monitor.h"
 #include "power.h"
+#include "policy.h"
 #include "res.h"
+#include "schedule.h"
+#include "session.h"
+#include "snapshot.h"
+// Generated by tools/strgen from str.rc and str_zh-CN.rc.
+#include "strtab.h"
 
 using namespace std;
 
 static HINSTANCE hInstance = NULL;
 // Silent mode: do not show notification on start.
 static bool silentMode = false;
+// Apply mode: apply the config once and exit, for a scheduled task triggered
+// by a display or power event. No window nor notification icon is created.
+static bool applyMode = false;
+// Benchmark mode: time the power request and the power scheme write paths,
+// and the cold start of apply mode, show the result and exit.
+static bool benchmarkMode = false;
 
 // ID of Shell_NotifyIconW.
 static const UINT NOTIFY_ID = 1;
@@ -29,11 +47,19 @@ static const UINT UM_NOTIFY = WM_USER + 1;
 
 // The extension of config file.
 static const auto CONFIG_FILE_NAME = L"SleepyLid.ini";
+// The name of policy bundle file, compiled by tools/policyc.
+// If present and valid, it takes the place of the [LidClosing] and
+// [Schedule] settings of the config file.
+static const auto POLICY_FILE_NAME = L"SleepyLid.policy";
+// Larger files are not policy bundles.
+static const LONGLONG POLICY_MAX_SIZE = 1 << 20;
 
 // The arv[0]. GetModuleFileNameW(0).
 wstring moduleFilePath;
 // The path of config file. Initialized in entry point.
 wstring configFilePath;
+// The path of policy bundle file. Initialized in entry point.
+wstring policyFilePath;
 // The command written to registry to enable-start-on-boot.
 wstring startOnBootCmd;
 
@@ -43,9 +69,14 @@ static const auto START_ON_BOOT_REG_SUB_KEY =
 static const auto START_ON_BOOT_REG_VALUE_NAME = L"SleepyLid";
 
 int _main(HINSTANCE hInstance, int argc, wchar_t *argv[], int nCmdShow);
+DWORD advanceSchedule();
+bool loadPolicy();
 void showNotification(HWND hwnd, bool silent = false);
 void removeNotification(HWND hwnd);
-void applyDisplayConnectivity();
+void trimFootprint();
+void applyDisplayConnectivity(bool onlyIfChanged = false);
+void trace(const wchar_t *format, ...);
+void armTimer(HWND hwnd, wakeupCause cause, DWORD delay);
 void showError(const wchar_t *msg);
 void showError(const wchar_t *msg, const wchar_t *file, int line);
 void showError(DWORD lastError, const wchar_t *file, int line);
@@ -77,7 +108,7 @@ private:
     arrayType actions;
 
 public:
-    monitorActions() {}
+    monitorActions() : actions() {}
     bool set(const wstring str) {
         if (str.length() != actions.size()) {
             return false;
@@ -94,13 +125,17 @@ public:
         return true;
     }
 
-    wstring toString() {
+    int at(int index) const {
+        return actions[index];
+    }
+
+    wstring toString() const {
         wstring ret(actions.size(), L'0');
         std::transform(actions.begin(), actions.end(), ret.begin(), [](auto a) { return L'0' + a; });
         return ret;
     }
 
-    int connectedDC() {
+    int connectedDC() const {
         return actions[0];
     }
     void setConnectedDC(int index) {
@@ -109,7 +144,7 @@ public:
         actions[0] = index;
     }
 
-    int connectedAC() {
+    int connectedAC() const {
         return actions[1];
     }
     void setConnectedAC(int index) {
@@ -118,7 +153,7 @@ public:
         actions[1] = index;
     }
 
-    int disconnectedDC() {
+    int disconnectedDC() const {
         return actions[2];
     }
     void setDisconnectedDC(int index) {
@@ -127,7 +162,7 @@ public:
         actions[2] = index;
     }
 
-    int disconnectedAC() {
+    int disconnectedAC() const {
         return actions[3];
     }
     void setDisconnectedAC(int index) {
@@ -137,60 +172,323 @@ public:
     }
 };
 
-static map<UINT, wstring> stringResMap;
-const wstring &loadStringRes(UINT resId) {
-    const auto it = stringResMap.find(resId);
-    if (it != stringResMap.end()) {
-        return it->second;
+// The string table of the UI language, a row of STRINGS_U16. Atomic like the
+// state snapshot, so any thread may load strings.
+static std::atomic<const char16_t *const *> uiStrings{STRINGS_U16[0]};
+
+// wchar_t is UTF-16 on Windows, so the strings are used as is.
+static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t must be UTF-16");
+static const wchar_t *toWide(const char16_t *str) {
+    return reinterpret_cast<const wchar_t *>(str);
+}
+
+// Load the string resId of the UI language. The string is static data of the
+// module, so it's never copied or freed.
+const wchar_t *loadStringRes(UINT resId) {
+    return toWide(uiStrings.load()[resId - STRING_BASE]);
+}
+
+// Index of the user's UI language in LOCALE_NAMES: the same locale, else the
+// same language, else the default.
+static int userLocale() {
+    wchar_t name[LOCALE_NAME_MAX_LENGTH] = {0};
+    if (LCIDToLocaleName(MAKELCID(GetUserDefaultUILanguage(), SORT_DEFAULT), name, LOCALE_NAME_MAX_LENGTH, 0) == 0) {
+        return 0;
     }
-    wchar_t *buf = NULL;
-    const int n = LoadStringW(hInstance, resId, (LPWSTR)&buf, 0);
-    if (n == 0) {
-        SHOW_LAST_ERROR();
-        std::exit(1);
+    for (int i = 0; i < LOCALE_COUNT; i++) {
+        if (_wcsicmp(name, LOCALE_NAMES[i]) == 0) {
+            return i;
+        }
     }
-    stringResMap[resId] = wstring(buf, n);
-    return stringResMap[resId];
+    for (int i = 0; i < LOCALE_COUNT; i++) {
+        const size_t n = wcscspn(LOCALE_NAMES[i], L"-");
+        if (_wcsnicmp(name, LOCALE_NAMES[i], n) == 0 && (name[n] == L'-' || name[n] == L'\0')) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Switch the UI language to LOCALE_NAMES[locale], or to the user's UI
+// language if locale is -1.
+static void setUiLanguage(int locale) {
+    if (locale < 0 || locale >= LOCALE_COUNT) {
+        locale = userLocale();
+    }
+    uiStrings.store(STRINGS_U16[locale]);
+}
+
+// Runtime state, published as immutable snapshots in state.
+// The settings are here, so that a reader on any thread sees them consistent.
+// The bookkeeping of event handling is not: lastTopology, arrivedMonitors,
+// session, policyWriteTime, timers and the counters are only used on
+// the thread of the main window, which processes all events.
+struct appState {
+    bool configExists = false;
+    bool syncMonitor = false;
+    // Low-footprint mode: load resources only when needed and trim the
+    // working set when idle.
+    bool lowFootprint = false;
+    // Hold a power request while an external monitor is connected instead of
+    // writing actions to the power scheme.
+    bool powerRequest = false;
+    // Write the actions to the power scheme when the power scheme does not
+    // allow away mode, which the request needs. Off: nothing is applied then.
+    bool powerRequestFallback = false;
+    // Below lowBatteryPercent on battery, lowBatteryAction is taken on lid
+    // closing whether external monitors are connected or not. 0 disables it.
+    int lowBatteryPercent = 0;
+    int lowBatteryAction = INDEX_HIBERNATE;
+    // The power supply, kept up to date by PBT_POWERSETTINGCHANGE.
+    bool onBattery = false;
+    DWORD batteryPercent = 100;
+    // Power band(POWER_BAND_AC etc.) of the power supply.
+    BYTE band = POWER_BAND_AC;
+    // UI language, index of LOCALE_NAMES. -1 follows the user's UI language.
+    int language = -1;
+    monitorActions actions;
+    // Time-of-day rules of the config file overriding actions.
+    // Shared by the snapshots copied from one another.
+    shared_ptr<const vector<scheduleRule>> scheduleRules;
+    // View of the policy bundle in effect, or NULL. Unmapped when the last
+    // snapshot referring to it is dropped.
+    shared_ptr<const policyHeader> policy;
+    // Wheel of the rules in effect, of policy or scheduleRules.
+    scheduleWheel schedule;
+    // Actions overridden by the schedule at present.
+    scheduleOverlay overlay;
+};
+static snapshot<appState> state;
+
+// The low battery threshold and action in effect: from the policy bundle if
+// any, otherwise from the config.
+static int lowBatteryPercentInEffect(const appState &s) {
+    return s.policy != NULL ? s.policy->lowBatteryPercent : s.lowBatteryPercent;
 }
 
-static bool configExists = false;
-static bool syncMonitor = false;
-static monitorActions actions;
+static int lowBatteryActionInEffect(const appState &s) {
+    return s.policy != NULL ? s.policy->lowBatteryAction : s.lowBatteryAction;
+}
+
+// Update the power band of s after the power supply or the low battery
+// threshold changed.
+static void updatePowerBand(appState &s) {
+    s.band = powerBand(s.onBattery, s.batteryPercent, lowBatteryPercentInEffect(s), s.band);
+}
+
+// Reset the wheel of s to the rules in effect.
+static void resetSchedule(appState &s) {
+    if (s.policy != NULL) {
+        s.schedule.reset(policyRules(s.policy.get()), s.policy->ruleCount);
+    } else if (s.scheduleRules != NULL) {
+        s.schedule.reset(s.scheduleRules->data(), s.scheduleRules->size());
+    } else {
+        s.schedule.reset(NULL, 0);
+    }
+}
 
 // ini section name.
 static const auto CONFIG_LID_CLOSING = L"LidClosing";
 // ini key.
 static const auto CONFIG_SYNC_MONITOR = L"SyncMonitor";
 static const auto CONFIG_MONITOR_POWER_ACTIONS = L"MonitorActions";
+static const auto CONFIG_POWER_REQUEST = L"PowerRequest";
+static const auto CONFIG_POWER_REQUEST_FALLBACK = L"PowerRequestFallback";
+static const auto CONFIG_LOW_BATTERY_PERCENT = L"LowBatteryPercent";
+static const auto CONFIG_LOW_BATTERY_ACTION = L"LowBatteryAction";
+// ini section name. Keys are Rule1, Rule2 etc. in the format of parseScheduleRule.
+static const auto CONFIG_SCHEDULE = L"Schedule";
+// ini section name.
+static const auto CONFIG_GENERAL = L"General";
+// ini key.
+static const auto CONFIG_LOW_FOOTPRINT = L"LowFootprint";
+static const auto CONFIG_LANGUAGE = L"Language";
 
 // Read settings from config file.
 void readConfig() {
     if (!PathFileExistsW(configFilePath.c_str())) {
         return;
     }
-    configExists = true;
-    syncMonitor = GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_SYNC_MONITOR, 0, configFilePath.c_str()) != 0;
+    const bool lowFootprint = GetPrivateProfileIntW(CONFIG_GENERAL, CONFIG_LOW_FOOTPRINT, 0, configFilePath.c_str()) != 0;
+    int language = -1;
+    std::array<wchar_t, LOCALE_NAME_MAX_LENGTH> name;
+    GetPrivateProfileStringW(CONFIG_GENERAL, CONFIG_LANGUAGE, L"", name.data(), name.size(), configFilePath.c_str());
+    for (int i = 0; i < LOCALE_COUNT; i++) {
+        if (_wcsicmp(name.data(), LOCALE_NAMES[i]) == 0) {
+            language = i;
+        }
+    }
+    const bool syncMonitor = GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_SYNC_MONITOR, 0, configFilePath.c_str()) != 0;
+    const bool powerRequest = GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_POWER_REQUEST, 0, configFilePath.c_str()) != 0;
+    const bool powerRequestFallback = GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_POWER_REQUEST_FALLBACK, 0, configFilePath.c_str()) != 0;
+    const int lowBatteryPercent = min(100, (int)GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_LOW_BATTERY_PERCENT, 0, configFilePath.c_str()));
+    int lowBatteryAction = GetPrivateProfileIntW(CONFIG_LID_CLOSING, CONFIG_LOW_BATTERY_ACTION, INDEX_HIBERNATE, configFilePath.c_str());
+    if (lowBatteryAction < INDEX_DO_NOTHING || lowBatteryAction > INDEX_SHUT_DOWN) {
+        lowBatteryAction = INDEX_HIBERNATE;
+    }
+    monitorActions actions;
     std::array<wchar_t, 5> buf;
     if (GetPrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_MONITOR_POWER_ACTIONS, L"0000",
                                  buf.data(), buf.size(),
                                  configFilePath.c_str()) == buf.size() - 1) {
         actions.set(buf.data());
     }
+
+    const auto scheduleRules = make_shared<vector<scheduleRule>>();
+    std::array<wchar_t, 64> rule;
+    for (int i = 1;; i++) {
+        const wstring key = L"Rule" + to_wstring(i);
+        if (GetPrivateProfileStringW(CONFIG_SCHEDULE, key.c_str(), L"",
+                                     rule.data(), rule.size(),
+                                     configFilePath.c_str()) == 0) {
+            break;
+        }
+        scheduleRule parsed;
+        if (parseScheduleRule(rule.data(), parsed)) {
+            scheduleRules->push_back(parsed);
+        }
+    }
+
+    state.update([&](appState &s) {
+        s.configExists = true;
+        s.lowFootprint = lowFootprint;
+        s.language = language;
+        s.syncMonitor = syncMonitor;
+        s.powerRequest = powerRequest;
+        s.powerRequestFallback = powerRequestFallback;
+        s.lowBatteryPercent = max(0, lowBatteryPercent);
+        s.lowBatteryAction = lowBatteryAction;
+        updatePowerBand(s);
+        s.actions = actions;
+        s.scheduleRules = scheduleRules;
+        resetSchedule(s);
+    });
 }
 
 // Write settings to config file.
 void writeConfig() {
+    const auto s = state.load();
+    WritePrivateProfileStringW(CONFIG_GENERAL, CONFIG_LOW_FOOTPRINT,
+                               s->lowFootprint ? L"1" : L"0",
+                               configFilePath.c_str());
+    WritePrivateProfileStringW(CONFIG_GENERAL, CONFIG_LANGUAGE,
+                               s->language >= 0 ? LOCALE_NAMES[s->language] : L"",
+                               configFilePath.c_str());
     WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_SYNC_MONITOR,
-                               syncMonitor ? L"1" : L"0",
+                               s->syncMonitor ? L"1" : L"0",
+                               configFilePath.c_str());
+    WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_POWER_REQUEST,
+                               s->powerRequest ? L"1" : L"0",
+                               configFilePath.c_str());
+    WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_POWER_REQUEST_FALLBACK,
+                               s->powerRequestFallback ? L"1" : L"0",
                                configFilePath.c_str());
-    const wstring str = actions.toString();
+    WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_LOW_BATTERY_PERCENT,
+                               to_wstring(s->lowBatteryPercent).c_str(),
+                               configFilePath.c_str());
+    WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_LOW_BATTERY_ACTION,
+                               to_wstring(s->lowBatteryAction).c_str(),
+                               configFilePath.c_str());
+    const wstring str = s->actions.toString();
     WritePrivateProfileStringW(CONFIG_LID_CLOSING, CONFIG_MONITOR_POWER_ACTIONS,
                                str.c_str(),
                                configFilePath.c_str());
 }
 
+// Last write time of the policy bundle file when it was last loaded.
+static FILETIME policyWriteTime = {0};
+static bool policyWriteTimeValid = false;
+
+// Map the policy bundle file if it changed since last load, and put it in
+// effect if it is valid.
+// Returns true if the policy in effect changed.
+bool loadPolicy() {
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {0};
+    if (!GetFileAttributesExW(policyFilePath.c_str(), GetFileExInfoStandard, &attributes)) {
+        policyWriteTimeValid = false;
+        if (state.load()->policy == NULL) {
+            return false;
+        }
+        // Removed. Fall back to the config file.
+        state.update([](appState &s) {
+            s.policy = NULL;
+            resetSchedule(s);
+            updatePowerBand(s);
+        });
+        return true;
+    }
+    if (policyWriteTimeValid && CompareFileTime(&attributes.ftLastWriteTime, &policyWriteTime) == 0) {
+        return false;
+    }
+
+    // A file with a mapped view can't be replaced or deleted, so the bundle
+    // is copied into a private mapping and the file is only open while it is
+    // read. FILE_SHARE_DELETE: do not block the replacement meanwhile.
+    const HANDLE file = CreateFileW(policyFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size = {0};
+    void *view = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= POLICY_MAX_SIZE) {
+        const HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size.LowPart, NULL);
+        if (mapping != NULL) {
+            view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+            CloseHandle(mapping);  // The view keeps the mapping.
+        }
+    }
+    DWORD read = 0;
+    const bool copied = view != NULL && ReadFile(file, view, size.LowPart, &read, NULL) && read == size.LowPart;
+    CloseHandle(file);
+    DWORD protect = 0;
+    if (!copied || !VirtualProtect(view, size.LowPart, PAGE_READONLY, &protect)) {
+        if (view != NULL) {
+            UnmapViewOfFile(view);
+        }
+        return false;
+    }
+    const auto header = validatePolicy(view, (size_t)size.QuadPart);
+    if (header == NULL) {
+        trace(L"Sleepy Lid: invalid policy bundle %s\n", policyFilePath.c_str());
+        UnmapViewOfFile(view);
+        return false;
+    }
+    // Only a bundle which loaded is not read again until it changes. One which
+    // failed, maybe while being written, is retried on the next refresh.
+    policyWriteTime = attributes.ftLastWriteTime;
+    policyWriteTimeValid = true;
+    const shared_ptr<const policyHeader> policy(header, [](const policyHeader *header) { UnmapViewOfFile(header); });
+    state.update([&](appState &s) {
+        s.policy = policy;
+        resetSchedule(s);
+        updatePowerBand(s);
+    });
+    return true;
+}
+
+// Whether to sync with external monitors, from the policy bundle if any.
+static bool syncMonitorInEffect(const appState &s) {
+    if (s.policy != NULL) {
+        return s.policy->syncMonitor != 0;
+    }
+    return s.configExists && s.syncMonitor;
+}
+
+// The action of slot(index in MonitorActions order) in effect: from the
+// policy bundle if any, otherwise from the config, overridden by the schedule.
+static int actionInEffect(const appState &s, int slot) {
+    const int base = s.policy != NULL ? s.policy->actions[slot] : s.actions.at(slot);
+    return s.overlay.action(slot, base);
+}
+
 void showError(const wchar_t *msg) {
-    MessageBoxW(NULL, msg, loadStringRes(STR_APP_NAME).c_str(), MB_ICONERROR);
+    if (applyMode) {
+        // Nobody may be there to close a message box.
+        trace(L"Sleepy Lid: %s\n", msg);
+        return;
+    }
+    MessageBoxW(NULL, msg, loadStringRes(STR_APP_NAME), MB_ICONERROR);
 }
 
 void showError(const wchar_t *msg, const wchar_t *file, int line) {
@@ -199,6 +497,16 @@ void showError(const wchar_t *msg, const wchar_t *file, int line) {
     showError(message);
 }
 
+// Write a formatted message to the debugger output.
+void trace(const wchar_t *format, ...) {
+    wchar_t message[256] = {0};
+    va_list args;
+    va_start(args, format);
+    StringCbVPrintfW(message, sizeof message, format, args);
+    va_end(args);
+    OutputDebugStringW(message);
+}
+
 // Show a message box with the error description of lastError.
 void showError(DWORD lastError, const wchar_t *file, int line) {
     wchar_t *msg = NULL;
@@ -208,30 +516,90 @@ void showError(DWORD lastError, const wchar_t *file, int line) {
     LocalFree(msg);
 }
 
+// Whether this process runs in the session attached to the physical console.
+// The lid and the power scheme belong to the machine, so with fast user
+// switching or remote desktop only the instance of the console session applies
+// them. The others stay dormant until their session gets the console.
+// Each session keeps its own instance, as the tray icon and the config are
+// per user; a service could show neither.
+static sessionSwitch session(true);
+static_assert(SESSION_CONSOLE_CONNECT == WTS_CONSOLE_CONNECT && SESSION_CONSOLE_DISCONNECT == WTS_CONSOLE_DISCONNECT,
+              "sessionEvent must match WTS_*");
+
+static bool isConsoleSession() {
+    DWORD sessionId = 0;
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), &sessionId))
+        return true;
+    return sessionId == WTSGetActiveConsoleSessionId();
+}
+
 LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 static bool alreadyRunning();
+static bool residentRunning();
+static void waitOtherApplies();
+static int applyOnce();
+static int runBenchmarks();
+static HANDLE watchPolicyDirectory();
+static bool processPolicyDirectoryChanges(HWND hwnd);
+static void unwatchPolicyDirectory();
 
 int _main(HINSTANCE instanceHandle, int argc, wchar_t *argv[], int nCmdShow) {
-    if (alreadyRunning()) {
-        MessageBoxW(NULL, loadStringRes(STR_ALREADY_RUNNING).c_str(), loadStringRes(STR_APP_NAME).c_str(), MB_ICONERROR);
-        return 1;
-    }
     if (argc > 1) {
         const auto argv1 = wstring(argv[1]);
         silentMode = (argv1 == L"/silent" || argv1 == L"-silent");
+        applyMode = (argv1 == L"/apply" || argv1 == L"-apply");
+        benchmarkMode = (argv1 == L"/benchmark" || argv1 == L"-benchmark");
     }
     hInstance = instanceHandle;
+    setUiLanguage(-1);
+    if (benchmarkMode) {
+        return runBenchmarks();
+    }
+    if (applyMode) {
+        // The mutex of the resident instance is not taken, so that one
+        // starting meanwhile does not find it and quit.
+        if (residentRunning()) {
+            // The running instance follows the displays itself.
+            return 0;
+        }
+        waitOtherApplies();
+    } else if (alreadyRunning()) {
+        MessageBoxW(NULL, loadStringRes(STR_ALREADY_RUNNING), loadStringRes(STR_APP_NAME), MB_ICONERROR);
+        return 1;
+    }
+    session = sessionSwitch(isConsoleSession());
+    if (applyMode && !session.active()) {
+        // Only the console session applies, as a resident instance would.
+        trace(L"Sleepy Lid: not the console session, nothing applied\n");
+        return 0;
+    }
 
     // Initialize configFilePath.
     moduleFilePath = argv[0];
     configFilePath = moduleFilePath;
     const auto sep = configFilePath.rfind(L'\\');
     if (sep != string::npos) {
+        policyFilePath = configFilePath.substr(0, sep + 1) + POLICY_FILE_NAME;
         configFilePath = configFilePath.substr(0, sep + 1) + CONFIG_FILE_NAME;
     }
     startOnBootCmd = wstring(L"\"") + moduleFilePath + L"\" /silent";
 
     readConfig();
+    setUiLanguage(state.load()->language);
+    loadPolicy();
+    advanceSchedule();
+    bool onBattery = false;
+    DWORD batteryPercent = 100;
+    if (readPowerSupply(&onBattery, &batteryPercent)) {
+        state.update([&](appState &s) {
+            s.onBattery = onBattery;
+            s.batteryPercent = batteryPercent;
+            updatePowerBand(s);
+        });
+    }
+    if (applyMode) {
+        return applyOnce();
+    }
 
     applyDisplayConnectivity();
 
@@ -239,7 +607,10 @@ int _main(HINSTANCE instanceHandle, int argc, wchar_t *argv[], int nCmdShow) {
     WNDCLASSEXW cls = {0};
     cls.cbSize = sizeof cls;
     cls.hInstance = hInstance;
-    cls.hIcon = LoadIconW(hInstance, MAKEINTRESOURCEW(ICON_MAIN));
+    if (!state.load()->lowFootprint) {
+        // The window is never shown. The class icon is only for debugging.
+        cls.hIcon = LoadIconW(hInstance, MAKEINTRESOURCEW(ICON_MAIN));
+    }
     cls.lpszClassName = classsName;
     cls.lpfnWndProc = MainWndProc;
     auto clsAtom = RegisterClassExW(&cls);
@@ -265,14 +636,33 @@ int _main(HINSTANCE instanceHandle, int argc, wchar_t *argv[], int nCmdShow) {
     // ShowWindow(hwnd, nCmdShow);
     // UpdateWindow(hwnd);
 
-    MSG msg;
-    BOOL fGotMessage;
-    while ((fGotMessage = GetMessage(&msg, (HWND)NULL, 0, 0)) != 0 &&
-           fGotMessage != -1) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+    // Watch the directory of the policy bundle, so that a new bundle takes
+    // effect when it lands.
+    HANDLE policyChange = watchPolicyDirectory();
+
+    MSG msg = {0};
+    for (;;) {
+        const DWORD handleCount = policyChange != NULL ? 1 : 0;
+        const DWORD ret = MsgWaitForMultipleObjects(handleCount, &policyChange, FALSE, INFINITE, QS_ALLINPUT);
+        if (ret == WAIT_OBJECT_0 && handleCount == 1) {
+            if (!processPolicyDirectoryChanges(hwnd)) {
+                policyChange = NULL;
+            }
+            continue;
+        }
+        if (ret == WAIT_FAILED) {
+            SHOW_LAST_ERROR();
+            return 1;
+        }
+        while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                unwatchPolicyDirectory();
+                return (int)msg.wParam;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
     }
-    return msg.wParam;
 }
 
 static const auto RUNNING_MUTEX_NAME = L"Sleepy Lid is running";
@@ -284,40 +674,224 @@ static bool alreadyRunning() {
     return GetLastError() == ERROR_ALREADY_EXISTS;
 }
 
-// Timer id for delaying the WM_DEVICECHANGE message processing.
-static const UINT_PTR DELAY_DEVICE_CHANGE_TIMER = 1;
+// Whether a resident instance runs in this session.
+static bool residentRunning() {
+    const HANDLE mutex = OpenMutexW(SYNCHRONIZE, FALSE, RUNNING_MUTEX_NAME);
+    if (mutex == NULL) {
+        return false;
+    }
+    CloseHandle(mutex);
+    return true;
+}
+
+// Serializes apply mode runs, which read and write [State] of the config.
+static const auto APPLYING_MUTEX_NAME = L"Sleepy Lid is applying";
+
+// Wait for the apply mode runs started before this one to end. The mutex is
+// owned until the process exits.
+static void waitOtherApplies() {
+    const HANDLE mutex = CreateMutexW(NULL, FALSE, APPLYING_MUTEX_NAME);
+    if (mutex == NULL) {
+        return;
+    }
+    // WAIT_ABANDONED: the owner exited, which is how runs end.
+    WaitForSingleObject(mutex, INFINITE);
+}
+
+// Timer id of the deadline timer.
+static const UINT_PTR DEADLINE_TIMER = 1;
+// All the timers of the process.
+static deadlineTimer timers(DEADLINE_TIMER);
 // Batch interval of  WM_DEVICECHANGE message processing.
 static const UINT DEVICE_CHANGE_DELAY = 3000;
+// Delay of the re-check after a monitor interface arrival or removal, in case
+// the display configuration was not updated yet when the event was received.
+static const UINT MONITOR_SETTLE_DELAY = 1000;
+// Delay of writing the config file after a setting is changed, so that
+// successive changes are written once.
+static const UINT CONFIG_FLUSH_DELAY = 2000;
+// Delay of reloading the policy bundle after its directory changed.
+static const UINT POLICY_SETTLE_DELAY = 500;
+
+// Device instance ids of the monitors seen arriving. Used to drop duplicated
+// arrival notifications.
+static set<wstring> arrivedMonitors;
+// Whether any monitor interface notification has been received. Once it is,
+// DBT_DEVNODES_CHANGED is no longer needed as a fallback.
+static bool monitorInterfaceNotified = false;
+
+// Fingerprint of the display topology at the last apply.
+static UINT64 lastTopology = 0;
+// Power band(POWER_BAND_AC etc.) at the last apply.
+static BYTE lastPowerBand = 0;
+// Whether lastTopology and lastPowerBand are valid.
+static bool lastTopologyValid = false;
+// Number of device change events processed, and how many of them were
+// skipped because neither the display topology nor the power source changed.
+static UINT deviceChangeCount = 0;
+static UINT deviceChangeSkipped = 0;
+
+// Private bytes allowed after trimming in low-footprint mode.
+static const SIZE_T FOOTPRINT_PRIVATE_BUDGET = 2 << 20;
+// Private bytes measured after the last trim, and number of trims which left
+// more than FOOTPRINT_PRIVATE_BUDGET.
+static SIZE_T trimmedPrivateBytes = 0;
+static UINT overBudgetTrims = 0;
+
+// A display link is flapping after FLAP_TRANSITIONS transitions within
+// FLAP_WINDOW, and settles after FLAP_SETTLE without transition.
+static const unsigned FLAP_TRANSITIONS = 4;
+static const UINT FLAP_WINDOW = 10000;
+static const UINT FLAP_SETTLE = 30000;
+static flapDetector displayFlap(FLAP_TRANSITIONS, FLAP_WINDOW, FLAP_SETTLE);
+// Power scheme writes caused by events: bursts of POWER_WRITE_BURST, then one
+// every POWER_WRITE_INTERVAL(6 per minute).
+static const unsigned POWER_WRITE_BURST = 3;
+static const UINT POWER_WRITE_INTERVAL = 10000;
+static tokenBucket powerWrites(POWER_WRITE_BURST, POWER_WRITE_INTERVAL);
+
+// The main window, NULL before it is created.
+static HWND mainWindow = NULL;
+
+// Apply the display connectivity again after delay.
+static void retryDisplayConnectivity(ULONGLONG delay) {
+    if (mainWindow != NULL) {
+        armTimer(mainWindow, WAKEUP_RETRY, (DWORD)delay);
+    }
+}
+
+// Whether the lid close actions of the active scheme differ from dc and ac.
+static DWORD lidCloseActionsDiffer(DWORD dc, DWORD ac, bool *differ) {
+    DWORD currentDC = 0;
+    DWORD currentAC = 0;
+    DWORD ret = readLidCloseActionIndexDC(&currentDC);
+    if (ret == ERROR_SUCCESS) {
+        ret = readLidCloseActionIndexAC(&currentAC);
+    }
+    if (ret == ERROR_SUCCESS) {
+        *differ = currentDC != dc || currentAC != ac;
+    }
+    return ret;
+}
+
+// Microseconds elapsed since start, a QueryPerformanceCounter value.
+static LONGLONG microsecondsSince(const LARGE_INTEGER &start) {
+    LARGE_INTEGER now = {0};
+    LARGE_INTEGER frequency = {0};
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (now.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+// Whether the power scheme does not allow away mode, so the request of power
+// request mode was refused. Traced once when it changes.
+static bool powerRequestRefused = false;
+
+// Hold or release the keep-awake request in power request mode.
+// handled is set to whether the lid closing is taken care of, so that the
+// actions are not to be written to the power scheme.
+// Return value is the error code(ERROR_SUCCESS etc.).
+static DWORD applyPowerRequest(const appState &s, bool connected, BYTE band, bool *handled) {
+    *handled = false;
+    if (!s.powerRequest) {
+        return ERROR_SUCCESS;
+    }
+    bool awayMode = false;
+    DWORD ret = readAwayModeAllowed(band != POWER_BAND_AC, &awayMode);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+    if (!awayMode) {
+        // The request would not keep the lid closing awake. The power scheme
+        // is only written instead if the config says so.
+        if (!powerRequestRefused) {
+            trace(L"Sleepy Lid: away mode not allowed, power request mode %s\n",
+                  s.powerRequestFallback ? L"falls back to the power scheme" : L"refused");
+        }
+        powerRequestRefused = true;
+        *handled = !s.powerRequestFallback;
+        return setKeepAwakeRequest(false);
+    }
+    powerRequestRefused = false;
+    // On low battery the lid closing is left to the power scheme.
+    ret = setKeepAwakeRequest(connected && band != POWER_BAND_DC_LOW);
+    *handled = ret == ERROR_SUCCESS;
+    return ret;
+}
 
 // Set power action based on the current display connectivity.
-void applyDisplayConnectivity() {
-    if (!configExists) {
+// If onlyIfChanged is true, nothing is done when the display topology and the
+// power band are the same as the last apply.
+void applyDisplayConnectivity(bool onlyIfChanged) {
+    const auto s = state.load();
+    if (!session.active() || !syncMonitorInEffect(*s)) {
+        setKeepAwakeRequest(false);
         return;
     }
-    if (!syncMonitor)
-        return;
+
+    UINT64 topology = 0;
+    const BYTE band = s->band;
+    const bool fingerprinted = displayTopologyFingerprint(&topology) == ERROR_SUCCESS;
+    if (onlyIfChanged) {
+        deviceChangeCount++;
+        if (fingerprinted && lastTopologyValid &&
+            topology == lastTopology && band == lastPowerBand) {
+            deviceChangeSkipped++;
+            return;
+        }
+    }
+
     // Last state of external monitors.
     bool connected = false;
+    bool differ = true;
+    DWORD dc = 0;
+    DWORD ac = 0;
+    bool handled = false;
+    const ULONGLONG now = GetTickCount64();
     auto ret = isExternalMonitorsConnected(&connected);
     if (ret != ERROR_SUCCESS)
         goto handle_error;
-    if (connected) {
-        ret = writeLidCloseActionIndexDC(actions.connectedDC());
-        if (ret != ERROR_SUCCESS)
-            goto handle_error;
-
-        ret = writeLidCloseActionIndexAC(actions.connectedAC());
+    connected = displayFlap.update(connected, now);
+    if (displayFlap.flapping()) {
+        trace(L"Sleepy Lid: display link flapping, %u flaps\n", displayFlap.flaps());
+        retryDisplayConnectivity(displayFlap.settleTime() - now);
+    }
+    ret = applyPowerRequest(*s, connected, band, &handled);
+    if (ret != ERROR_SUCCESS)
+        goto handle_error;
+    if (!handled) {
+        // The request is not needed any more if the mode was just switched off.
+        ret = setKeepAwakeRequest(false);
         if (ret != ERROR_SUCCESS)
             goto handle_error;
-    } else {
-        ret = writeLidCloseActionIndexDC(actions.disconnectedDC());
+        dc = actionInEffect(*s, connected ? 0 : 2);
+        ac = actionInEffect(*s, connected ? 1 : 3);
+        if (band == POWER_BAND_DC_LOW) {
+            dc = lowBatteryActionInEffect(*s);
+        }
+        // Writing activates the scheme again. Skip it if nothing would change.
+        ret = lidCloseActionsDiffer(dc, ac, &differ);
         if (ret != ERROR_SUCCESS)
             goto handle_error;
+        if (differ) {
+            if (onlyIfChanged && !powerWrites.take(now)) {
+                trace(L"Sleepy Lid: power scheme write deferred, %u deferrals\n", powerWrites.denials());
+                retryDisplayConnectivity(powerWrites.wait(now));
+                return;
+            }
+            ret = writeLidCloseActionIndexDC(dc);
+            if (ret != ERROR_SUCCESS)
+                goto handle_error;
 
-        ret = writeLidCloseActionIndexAC(actions.disconnectedAC());
-        if (ret != ERROR_SUCCESS)
-            goto handle_error;
+            ret = writeLidCloseActionIndexAC(ac);
+            if (ret != ERROR_SUCCESS)
+                goto handle_error;
+        }
     }
+
+    lastTopologyValid = fingerprinted;
+    lastTopology = topology;
+    lastPowerBand = band;
     return;
 
 handle_error:
@@ -325,9 +899,399 @@ handle_error:
     exit(1);
 }
 
-void CALLBACK DelayDeviceChangeTimerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
-    KillTimer(hwnd, DELAY_DEVICE_CHANGE_TIMER);  // Make it one time timer.
-    applyDisplayConnectivity();
+// Arm the timer of cause and show the error if failed.
+void armTimer(HWND hwnd, wakeupCause cause, DWORD delay) {
+    const auto ret = timers.arm(hwnd, cause, delay);
+    if (ret != ERROR_SUCCESS) {
+        SHOW_ERROR(ret);
+    }
+}
+
+// Move the schedule to the current local time.
+// Returns the milliseconds until the next transition, or 0 if there is none.
+DWORD advanceSchedule() {
+    SYSTEMTIME now = {0};
+    GetLocalTime(&now);
+    const int dayOfWeek = (now.wDayOfWeek + 6) % 7;  // Monday is 0.
+    const int minuteOfWeek = dayOfWeek * MINUTES_PER_DAY + now.wHour * 60 + now.wMinute;
+    int minutes = -1;
+    state.update([&](appState &s) {
+        minutes = s.schedule.advance(minuteOfWeek, s.overlay);
+    });
+    if (minutes < 0) {
+        return 0;
+    }
+    return minutes * 60000 - (now.wSecond * 1000 + now.wMilliseconds);
+}
+
+// Move the schedule to the current local time and arm the timer of the next
+// transition. Called on start, on transitions, after resuming and when the
+// system time changes. A dormant session does not follow the schedule.
+void updateSchedule(HWND hwnd) {
+    if (!session.active()) {
+        timers.disarm(hwnd, WAKEUP_SCHEDULE);
+        return;
+    }
+    const DWORD delay = advanceSchedule();
+    if (delay == 0) {
+        timers.disarm(hwnd, WAKEUP_SCHEDULE);
+    } else {
+        armTimer(hwnd, WAKEUP_SCHEDULE, delay);
+    }
+}
+
+// Reload the policy bundle if it changed, and put it in effect.
+void refreshPolicy(HWND hwnd) {
+    if (loadPolicy()) {
+        updateSchedule(hwnd);
+        applyDisplayConnectivity();
+    }
+}
+
+// Process a change of the policy bundle file.
+// Writes come in bursts, so the bundle is reloaded after they settle.
+void processPolicyChange(HWND hwnd) {
+    armTimer(hwnd, WAKEUP_POLICY_CHANGE, POLICY_SETTLE_DELAY);
+}
+
+// Handle of the directory of the policy bundle, opened for watching it, and
+// the read of its changes in progress.
+static HANDLE policyDirectory = INVALID_HANDLE_VALUE;
+static OVERLAPPED policyWatch = {0};
+// FILE_NOTIFY_INFORMATION records of the read, which are DWORD aligned.
+static DWORD policyChanges[256];
+
+// Start reading the next changes of the directory of the policy bundle.
+static bool readPolicyChanges() {
+    return ReadDirectoryChangesW(policyDirectory, policyChanges, sizeof policyChanges, FALSE,
+                                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                 NULL, &policyWatch, NULL) != FALSE;
+}
+
+// Watch the directory of the policy bundle.
+// Returns the event signaled when changes were read, or NULL if the directory
+// can't be watched.
+static HANDLE watchPolicyDirectory() {
+    const wstring directory = policyFilePath.substr(0, policyFilePath.rfind(L'\\') + 1);
+    policyDirectory = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (policyDirectory != INVALID_HANDLE_VALUE) {
+        policyWatch.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    }
+    if (policyWatch.hEvent == NULL || !readPolicyChanges()) {
+        trace(L"Sleepy Lid: policy directory not watched, error %lu\n", GetLastError());
+        unwatchPolicyDirectory();
+        return NULL;
+    }
+    return policyWatch.hEvent;
+}
+
+static void unwatchPolicyDirectory() {
+    if (policyDirectory != INVALID_HANDLE_VALUE) {
+        CancelIo(policyDirectory);
+        CloseHandle(policyDirectory);
+        policyDirectory = INVALID_HANDLE_VALUE;
+    }
+    if (policyWatch.hEvent != NULL) {
+        CloseHandle(policyWatch.hEvent);
+        policyWatch.hEvent = NULL;
+    }
+}
+
+// Process the changes read from the directory of the policy bundle and read
+// the next ones. Changes of other files, like the config file written by this
+// process, are ignored.
+// Returns false if the directory is not watched any more.
+static bool processPolicyDirectoryChanges(HWND hwnd) {
+    DWORD bytes = 0;
+    if (!GetOverlappedResult(policyDirectory, &policyWatch, &bytes, FALSE)) {
+        trace(L"Sleepy Lid: policy directory watch stopped, error %lu\n", GetLastError());
+        unwatchPolicyDirectory();
+        return false;
+    }
+    // No record: too many changes to fit, which may include the bundle.
+    bool changed = bytes == 0;
+    for (DWORD offset = 0; !changed && offset < bytes;) {
+        const auto info = (const FILE_NOTIFY_INFORMATION *)((const BYTE *)policyChanges + offset);
+        changed = CompareStringOrdinal(info->FileName, info->FileNameLength / sizeof(wchar_t),
+                                       POLICY_FILE_NAME, -1, TRUE) == CSTR_EQUAL;
+        if (info->NextEntryOffset == 0) {
+            break;
+        }
+        offset += info->NextEntryOffset;
+    }
+    if (changed) {
+        processPolicyChange(hwnd);
+    }
+    if (!readPolicyChanges()) {
+        trace(L"Sleepy Lid: policy directory watch stopped, error %lu\n", GetLastError());
+        unwatchPolicyDirectory();
+        return false;
+    }
+    return true;
+}
+
+// Trace the wakeup and footprint counters. Called on demand when the menu is
+// opened, and at exit.
+static void traceSummary() {
+    trace(L"Sleepy Lid: wakeups: device change %u, config flush %u, schedule %u, retry %u, policy change %u, spurious %u; "
+          L"device changes skipped %u of %u; private bytes %zu, over budget %u\n",
+          timers.wakeups(WAKEUP_DEVICE_CHANGE), timers.wakeups(WAKEUP_CONFIG_FLUSH),
+          timers.wakeups(WAKEUP_SCHEDULE), timers.wakeups(WAKEUP_RETRY),
+          timers.wakeups(WAKEUP_POLICY_CHANGE), timers.spuriousWakeups(),
+          deviceChangeSkipped, deviceChangeCount, trimmedPrivateBytes, overBudgetTrims);
+}
+
+// Write the config now if a write is pending.
+static void flushConfig(HWND hwnd) {
+    if (timers.armed(WAKEUP_CONFIG_FLUSH)) {
+        timers.disarm(hwnd, WAKEUP_CONFIG_FLUSH);
+        writeConfig();
+    }
+}
+
+// Process WM_TIMER of DEADLINE_TIMER.
+void processDeadline(HWND hwnd) {
+    const UINT due = timers.expire(hwnd);
+    if (due & (1 << WAKEUP_POLICY_CHANGE)) {
+        refreshPolicy(hwnd);
+    }
+    if (due & (1 << WAKEUP_DEVICE_CHANGE)) {
+        applyDisplayConnectivity(true);
+    }
+    if (due & (1 << WAKEUP_CONFIG_FLUSH)) {
+        writeConfig();
+    }
+    if (due & (1 << WAKEUP_SCHEDULE)) {
+        updateSchedule(hwnd);
+        applyDisplayConnectivity();
+    }
+    if (due & (1 << WAKEUP_RETRY)) {
+        lastTopologyValid = false;  // Do not skip.
+        applyDisplayConnectivity(true);
+    }
+    if (state.load()->lowFootprint) {
+        trimFootprint();
+    }
+}
+
+// Process the arrival or removal of a monitor interface.
+void processMonitorInterfaceChange(HWND hwnd, bool arrival, const wstring &instanceId) {
+    monitorInterfaceNotified = true;
+    if (arrival) {
+        if (!arrivedMonitors.insert(instanceId).second) {
+            return;
+        }
+    } else {
+        arrivedMonitors.erase(instanceId);
+    }
+    applyDisplayConnectivity(true);
+    // The displays may not have settled yet, so the check after the delay
+    // applies even if the topology looks the same as now.
+    lastTopologyValid = false;
+    armTimer(hwnd, WAKEUP_DEVICE_CHANGE, MONITOR_SETTLE_DELAY);
+}
+
+// ini section name of the state carried from one apply mode run to the next.
+static const auto CONFIG_STATE = L"State";
+// ini key.
+static const auto CONFIG_STATE_TOPOLOGY = L"Topology";
+static const auto CONFIG_STATE_POWER_BAND = L"PowerBand";
+static const auto CONFIG_STATE_SETTINGS = L"Settings";
+
+// FNV-1a of the settings in effect: from the config or the policy bundle,
+// with the schedule applied. A run with other settings than the last one
+// applies even if the displays stay the same.
+static UINT64 settingsInEffectHash(const appState &s) {
+    const BYTE settings[] = {
+        syncMonitorInEffect(s),
+        (BYTE)actionInEffect(s, 0), (BYTE)actionInEffect(s, 1),
+        (BYTE)actionInEffect(s, 2), (BYTE)actionInEffect(s, 3),
+        (BYTE)lowBatteryPercentInEffect(s), (BYTE)lowBatteryActionInEffect(s),
+    };
+    UINT64 hash = 0xCBF29CE484222325ULL;
+    for (const auto setting : settings) {
+        hash ^= setting;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static ULONGLONG fileTimeValue(const FILETIME &time) {
+    ULARGE_INTEGER value = {0};
+    value.LowPart = time.dwLowDateTime;
+    value.HighPart = time.dwHighDateTime;
+    return value.QuadPart;
+}
+
+// Apply the config once in apply mode. Nothing is written if the display
+// topology, the power band and the settings in effect are the same as the
+// last run.
+static int applyOnce() {
+    if (state.load()->powerRequest) {
+        // A power request ends with the process.
+        trace(L"Sleepy Lid: power request mode ignored in apply mode\n");
+        state.update([](appState &s) { s.powerRequest = false; });
+    }
+    const UINT64 settings = settingsInEffectHash(*state.load());
+    std::array<wchar_t, 17> buf;
+    // Whether [State] holds the result of a run with the same settings.
+    bool stored = false;
+    if (GetPrivateProfileStringW(CONFIG_STATE, CONFIG_STATE_SETTINGS, L"",
+                                 buf.data(), (DWORD)buf.size(), configFilePath.c_str()) > 0 &&
+        wcstoull(buf.data(), NULL, 16) == settings &&
+        GetPrivateProfileStringW(CONFIG_STATE, CONFIG_STATE_TOPOLOGY, L"",
+                                 buf.data(), (DWORD)buf.size(), configFilePath.c_str()) > 0) {
+        lastTopology = wcstoull(buf.data(), NULL, 16);
+        lastPowerBand = (BYTE)GetPrivateProfileIntW(CONFIG_STATE, CONFIG_STATE_POWER_BAND, 0, configFilePath.c_str());
+        lastTopologyValid = true;
+        stored = true;
+    }
+    const UINT64 storedTopology = lastTopology;
+    const BYTE storedPowerBand = lastPowerBand;
+
+    applyDisplayConnectivity(true);
+
+    // Most runs find nothing changed, and write nothing either.
+    if (lastTopologyValid &&
+        !(stored && lastTopology == storedTopology && lastPowerBand == storedPowerBand)) {
+        StringCchPrintfW(buf.data(), buf.size(), L"%016llX", lastTopology);
+        WritePrivateProfileStringW(CONFIG_STATE, CONFIG_STATE_TOPOLOGY, buf.data(), configFilePath.c_str());
+        WritePrivateProfileStringW(CONFIG_STATE, CONFIG_STATE_POWER_BAND,
+                                   to_wstring(lastPowerBand).c_str(), configFilePath.c_str());
+        StringCchPrintfW(buf.data(), buf.size(), L"%016llX", settings);
+        WritePrivateProfileStringW(CONFIG_STATE, CONFIG_STATE_SETTINGS, buf.data(), configFilePath.c_str());
+    }
+    // Cold start latency, from the process creation to the policy applied.
+    FILETIME creation = {0}, exited = {0}, kernel = {0}, user = {0}, now = {0};
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user)) {
+        GetSystemTimeAsFileTime(&now);
+        trace(L"Sleepy Lid: applied %llu us after process creation\n",
+              (fileTimeValue(now) - fileTimeValue(creation)) / 10);
+    }
+    return 0;
+}
+
+// Rounds of each path timed by runBenchmarks.
+static const int BENCHMARK_ROUNDS = 20;
+
+// Average microseconds from starting an apply mode run to its exit, or -1 if
+// it can't be started. Runs after the first find nothing changed, which is the
+// common case of the event-triggered task.
+static LONGLONG coldStartMicroseconds() {
+    std::array<wchar_t, MAX_PATH> path;
+    if (GetModuleFileNameW(NULL, path.data(), (DWORD)path.size()) == 0) {
+        return -1;
+    }
+    const wstring cmd = wstring(L"\"") + path.data() + L"\" /apply";
+    LARGE_INTEGER start = {0};
+    QueryPerformanceCounter(&start);
+    for (int i = 0; i < BENCHMARK_ROUNDS; i++) {
+        vector<wchar_t> cmdLine(cmd.begin(), cmd.end());
+        cmdLine.push_back(L'\0');
+        STARTUPINFOW startup = {0};
+        startup.cb = sizeof startup;
+        PROCESS_INFORMATION process = {0};
+        if (!CreateProcessW(path.data(), cmdLine.data(), NULL, NULL, FALSE, CREATE_NO_WINDOW,
+                            NULL, NULL, &startup, &process)) {
+            return -1;
+        }
+        WaitForSingleObject(process.hProcess, INFINITE);
+        CloseHandle(process.hThread);
+        CloseHandle(process.hProcess);
+    }
+    return microsecondsSince(start) / BENCHMARK_ROUNDS;
+}
+
+// Time the two ways of applying the lid closing: holding and releasing the
+// keep-awake request, and reading and writing the current actions to the
+// power scheme, as applyDisplayConnectivity does. The actions written are the
+// ones read, so the settings are left as they are. Then time the cold start
+// of apply mode.
+static int runBenchmarks() {
+    LARGE_INTEGER start = {0};
+    QueryPerformanceCounter(&start);
+    for (int i = 0; i < BENCHMARK_ROUNDS; i++) {
+        DWORD ret = setKeepAwakeRequest(true);
+        if (ret == ERROR_SUCCESS) {
+            ret = setKeepAwakeRequest(false);
+        }
+        if (ret != ERROR_SUCCESS) {
+            SHOW_ERROR(ret);
+            return 1;
+        }
+    }
+    const LONGLONG request = microsecondsSince(start) / (BENCHMARK_ROUNDS * 2);
+
+    QueryPerformanceCounter(&start);
+    for (int i = 0; i < BENCHMARK_ROUNDS; i++) {
+        DWORD dc = 0;
+        DWORD ac = 0;
+        DWORD ret = readLidCloseActionIndexDC(&dc);
+        if (ret == ERROR_SUCCESS) {
+            ret = readLidCloseActionIndexAC(&ac);
+        }
+        if (ret == ERROR_SUCCESS) {
+            ret = writeLidCloseActionIndexDC(dc);
+        }
+        if (ret == ERROR_SUCCESS) {
+            ret = writeLidCloseActionIndexAC(ac);
+        }
+        if (ret != ERROR_SUCCESS) {
+            SHOW_ERROR(ret);
+            return 1;
+        }
+    }
+    const LONGLONG scheme = microsecondsSince(start) / BENCHMARK_ROUNDS;
+    const LONGLONG coldStart = coldStartMicroseconds();
+
+    wchar_t message[256] = {0};
+    StringCbPrintfW(message, sizeof message,
+                    L"Power request hold or release: %lld us\nPower scheme read and write: %lld us\n"
+                    L"Apply mode cold start: %lld us\n(%d rounds)",
+                    request, scheme, coldStart, BENCHMARK_ROUNDS);
+    trace(L"Sleepy Lid: %s\n", message);
+    MessageBoxW(NULL, message, loadStringRes(STR_APP_NAME), MB_ICONINFORMATION);
+    return 0;
+}
+
+// Process PBT_POWERSETTINGCHANGE. Only a change of the power band is applied,
+// not every percent of battery drain.
+void processPowerSupplyChange(LPARAM lParam) {
+    bool notified = false;
+    const auto s = state.update([&](appState &s) {
+        notified = updatePowerSupply(lParam, &s.onBattery, &s.batteryPercent);
+        updatePowerBand(s);
+    });
+    if (!notified || (lastTopologyValid && s->band == lastPowerBand)) {
+        return;
+    }
+    applyDisplayConnectivity(true);
+}
+
+// Process WM_WTSSESSION_CHANGE of this session.
+void processSessionChange(HWND hwnd, WPARAM event) {
+    switch (session.update((unsigned)event)) {
+    case SESSION_ACTIVATED:
+        trace(L"Sleepy Lid: session attached to console, %u times\n", session.activationCount());
+        // Displays were not followed while dormant.
+        arrivedMonitors.clear();
+        lastTopologyValid = false;
+        updateSchedule(hwnd);
+        applyDisplayConnectivity();
+        break;
+    case SESSION_DORMANT:
+        trace(L"Sleepy Lid: session dormant\n");
+        timers.disarm(hwnd, WAKEUP_DEVICE_CHANGE);
+        timers.disarm(hwnd, WAKEUP_RETRY);
+        timers.disarm(hwnd, WAKEUP_SCHEDULE);
+        setKeepAwakeRequest(false);
+        trimFootprint();
+        break;
+    default:
+        break;
+    }
 }
 
 // Menu item IDs.
@@ -366,9 +1330,12 @@ enum {
     ID_MONITOR_DISCONNECTED_AC_SLEEP,
     ID_MONITOR_DISCONNECTED_AC_HIBERNATE,
     ID_MONITOR_DISCONNECTED_AC_SHUT_DOWN,
+
+    ID_LANGUAGE_FIRST,
+    ID_LANGUAGE_LAST = ID_LANGUAGE_FIRST + LOCALE_COUNT - 1,
 };
 
-static const wstring &powerActionToString(DWORD index) {
+static const wchar_t *powerActionToString(DWORD index) {
     switch (index) {
     case INDEX_DO_NOTHING:
         return loadStringRes(STR_DO_NOTHING);
@@ -435,6 +1402,9 @@ void disableStartOnBoot() {
 // Creates a popup menu which can be used to show when notification icon is
 // clicked.
 HMENU createNotifyPopupMenu() {
+    const auto s = state.load();
+    const auto &actions = s->actions;
+    const bool syncMonitor = s->syncMonitor;
     DWORD actionBattery = 0;
     DWORD ret = readLidCloseActionIndexDC(&actionBattery);
     if (ret != ERROR_SUCCESS) {
@@ -452,135 +1422,144 @@ HMENU createNotifyPopupMenu() {
     const HMENU onBattery = CreateMenu();
     AppendMenuW(onBattery,
                 MF_STRING | (actionBattery == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(onBattery,
                 MF_STRING | (actionBattery == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_DC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_DC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(onBattery,
                 MF_STRING | (actionBattery == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_DC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_DC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(onBattery,
                 MF_STRING | (actionBattery == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     HMENU pluggedIn = CreateMenu();
     AppendMenuW(pluggedIn,
                 MF_STRING | (actionPluggedIn == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(pluggedIn,
                 MF_STRING | (actionPluggedIn == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_AC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_AC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(pluggedIn,
                 MF_STRING | (actionPluggedIn == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_AC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_AC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(pluggedIn,
                 MF_STRING | (actionPluggedIn == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     const HMENU monitorConnectedDC = CreateMenu();
     AppendMenuW(monitorConnectedDC,
                 MF_STRING | (actions.connectedDC() == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_MONITOR_CONNECTED_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(monitorConnectedDC,
                 MF_STRING | (actions.connectedDC() == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_DC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_MONITOR_CONNECTED_DC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(monitorConnectedDC,
                 MF_STRING | (actions.connectedDC() == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_DC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_MONITOR_CONNECTED_DC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(monitorConnectedDC,
                 MF_STRING | (actions.connectedDC() == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_MONITOR_CONNECTED_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     const HMENU monitorConnectedAC = CreateMenu();
     AppendMenuW(monitorConnectedAC,
                 MF_STRING | (actions.connectedAC() == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_MONITOR_CONNECTED_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(monitorConnectedAC,
                 MF_STRING | (actions.connectedAC() == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_AC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_MONITOR_CONNECTED_AC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(monitorConnectedAC,
                 MF_STRING | (actions.connectedAC() == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_AC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_MONITOR_CONNECTED_AC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(monitorConnectedAC,
                 MF_STRING | (actions.connectedAC() == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_MONITOR_CONNECTED_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_MONITOR_CONNECTED_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     const HMENU monitorDisconnectedDC = CreateMenu();
     AppendMenuW(monitorDisconnectedDC,
                 MF_STRING | (actions.disconnectedDC() == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_MONITOR_DISCONNECTED_DC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(monitorDisconnectedDC,
                 MF_STRING | (actions.disconnectedDC() == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_DC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_MONITOR_DISCONNECTED_DC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(monitorDisconnectedDC,
                 MF_STRING | (actions.disconnectedDC() == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_DC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_MONITOR_DISCONNECTED_DC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(monitorDisconnectedDC,
                 MF_STRING | (actions.disconnectedDC() == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_MONITOR_DISCONNECTED_DC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     const HMENU monitorDisconnectedAC = CreateMenu();
     AppendMenuW(monitorDisconnectedAC,
                 MF_STRING | (actions.disconnectedAC() == INDEX_DO_NOTHING ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING).c_str());
+                ID_MONITOR_DISCONNECTED_AC_DO_NOTHING, loadStringRes(STR_DO_NOTHING));
     AppendMenuW(monitorDisconnectedAC,
                 MF_STRING | (actions.disconnectedAC() == INDEX_SLEEP ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_AC_SLEEP, loadStringRes(STR_SLEEP).c_str());
+                ID_MONITOR_DISCONNECTED_AC_SLEEP, loadStringRes(STR_SLEEP));
     AppendMenuW(monitorDisconnectedAC,
                 MF_STRING | (actions.disconnectedAC() == INDEX_HIBERNATE ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_AC_HIBERNATE, loadStringRes(STR_HIBERNATE).c_str());
+                ID_MONITOR_DISCONNECTED_AC_HIBERNATE, loadStringRes(STR_HIBERNATE));
     AppendMenuW(monitorDisconnectedAC,
                 MF_STRING | (actions.disconnectedAC() == INDEX_SHUT_DOWN ? MF_CHECKED : 0),
-                ID_MONITOR_DISCONNECTED_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN).c_str());
+                ID_MONITOR_DISCONNECTED_AC_SHUT_DOWN, loadStringRes(STR_SHUT_DOWN));
 
     std::array<wchar_t, 1024> buf;
 
     const HMENU monitor = CreateMenu();
-    AppendMenuW(monitor, MF_STRING | (syncMonitor ? MF_CHECKED : 0), ID_SYNC_MONITOR, loadStringRes(syncMonitor ? STR_ON : STR_OFF).c_str());
+    AppendMenuW(monitor, MF_STRING | (syncMonitor ? MF_CHECKED : 0), ID_SYNC_MONITOR, loadStringRes(syncMonitor ? STR_ON : STR_OFF));
     SetMenuDefaultItem(monitor, 0, TRUE);
 
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_MONITOR_CONNECTED_DC).c_str(),
-                    powerActionToString(actions.connectedDC()).c_str());
+                    loadStringRes(STR_FMT_MONITOR_CONNECTED_DC),
+                    powerActionToString(actions.connectedDC()));
     AppendMenuW(monitor, MF_STRING | MF_POPUP | MF_MENUBARBREAK | (syncMonitor ? 0 : MF_GRAYED), (UINT_PTR)monitorConnectedDC, buf.data());
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_MONITOR_CONNECTED_AC).c_str(),
-                    powerActionToString(actions.connectedAC()).c_str());
+                    loadStringRes(STR_FMT_MONITOR_CONNECTED_AC),
+                    powerActionToString(actions.connectedAC()));
     AppendMenuW(monitor, MF_STRING | MF_POPUP | (syncMonitor ? 0 : MF_GRAYED), (UINT_PTR)monitorConnectedAC, buf.data());
 
     AppendMenuW(monitor, MF_SEPARATOR, 0, NULL);
 
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_MONITOR_DISCONNECTED_DC).c_str(),
-                    powerActionToString(actions.disconnectedDC()).c_str());
+                    loadStringRes(STR_FMT_MONITOR_DISCONNECTED_DC),
+                    powerActionToString(actions.disconnectedDC()));
     AppendMenuW(monitor, MF_STRING | MF_POPUP | (syncMonitor ? 0 : MF_GRAYED), (UINT_PTR)monitorDisconnectedDC, buf.data());
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_MONITOR_DISCONNECTED_AC).c_str(),
-                    powerActionToString(actions.disconnectedAC()).c_str());
+                    loadStringRes(STR_FMT_MONITOR_DISCONNECTED_AC),
+                    powerActionToString(actions.disconnectedAC()));
     AppendMenuW(monitor, MF_STRING | MF_POPUP | (syncMonitor ? 0 : MF_GRAYED), (UINT_PTR)monitorDisconnectedAC, buf.data());
 
     const HMENU lidClosing = CreateMenu();
 
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_ON_BATTERY).c_str(),
-                    powerActionToString(actionBattery).c_str());
+                    loadStringRes(STR_FMT_ON_BATTERY),
+                    powerActionToString(actionBattery));
     AppendMenuW(lidClosing, MF_STRING | MF_POPUP, (UINT_PTR)onBattery, buf.data());
     StringCbPrintfW(buf.data(), buf.size() * sizeof(wchar_t),
-                    loadStringRes(STR_FMT_PLUGGED_IN).c_str(),
-                    powerActionToString(actionPluggedIn).c_str());
+                    loadStringRes(STR_FMT_PLUGGED_IN),
+                    powerActionToString(actionPluggedIn));
     AppendMenuW(lidClosing, MF_STRING | MF_POPUP, (UINT_PTR)pluggedIn, buf.data());
     AppendMenuW(lidClosing, MF_SEPARATOR, 0, NULL);
 
-    AppendMenuW(lidClosing, MF_STRING | MF_POPUP | (syncMonitor ? MF_CHECKED : 0), (UINT_PTR)monitor, loadStringRes(STR_SYNC_MONITOR).c_str());
+    // Settings in a policy bundle can't be changed.
+    AppendMenuW(lidClosing, MF_STRING | MF_POPUP | (syncMonitorInEffect(*s) ? MF_CHECKED : 0) | (s->policy != NULL ? MF_GRAYED : 0),
+                (UINT_PTR)monitor, loadStringRes(STR_SYNC_MONITOR));
 
     const HMENU menu = CreatePopupMenu();
-    AppendMenuW(menu, MF_POPUP, (UINT_PTR)lidClosing, loadStringRes(STR_WHEN_LID_CLOSING).c_str());
+    AppendMenuW(menu, MF_POPUP, (UINT_PTR)lidClosing, loadStringRes(STR_WHEN_LID_CLOSING));
     AppendMenuW(menu, MF_SEPARATOR, 0, NULL);
 
+    // Each language is named in itself.
+    const HMENU language = CreateMenu();
+    for (int i = 0; i < LOCALE_COUNT; i++) {
+        AppendMenuW(language, MF_STRING | (uiStrings.load() == STRINGS_U16[i] ? MF_CHECKED : 0),
+                    ID_LANGUAGE_FIRST + i, toWide(STRINGS_U16[i][STR_LANGUAGE_NAME - STRING_BASE]));
+    }
+    AppendMenuW(menu, MF_POPUP, (UINT_PTR)language, loadStringRes(STR_LANGUAGE));
     AppendMenuW(menu, MF_STRING | (startOnBootEnabled() ? MF_CHECKED : 0),
-                ID_AUTO_RUN, loadStringRes(STR_START_ON_BOOT).c_str());
+                ID_AUTO_RUN, loadStringRes(STR_START_ON_BOOT));
     AppendMenuW(menu, MF_SEPARATOR, 0, NULL);
-    AppendMenuW(menu, MF_STRING, ID_EXIT, loadStringRes(STR_EXIT).c_str());
+    AppendMenuW(menu, MF_STRING, ID_EXIT, loadStringRes(STR_EXIT));
     return menu;
 }
 
@@ -622,91 +1601,99 @@ void processNotifyMenuCmd(HWND hwnd, UINT_PTR cmd) {
         ret = writeLidCloseActionIndexAC(INDEX_SHUT_DOWN);
         break;
     case ID_SYNC_MONITOR:
-        syncMonitor = !syncMonitor;
-        if (syncMonitor) {
-            applyDisplayConnectivity();
-        }
-        writeConfig();
+        state.update([](appState &s) { s.syncMonitor = !s.syncMonitor; });
+        // Also releases the power request when turned off.
+        applyDisplayConnectivity();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_DC_DO_NOTHING:
-        actions.setConnectedDC(INDEX_DO_NOTHING);
+        state.update([](appState &s) { s.actions.setConnectedDC(INDEX_DO_NOTHING); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_DC_SLEEP:
-        actions.setConnectedDC(INDEX_SLEEP);
+        state.update([](appState &s) { s.actions.setConnectedDC(INDEX_SLEEP); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_DC_HIBERNATE:
-        actions.setConnectedDC(INDEX_HIBERNATE);
+        state.update([](appState &s) { s.actions.setConnectedDC(INDEX_HIBERNATE); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_DC_SHUT_DOWN:
-        actions.setConnectedDC(INDEX_SHUT_DOWN);
+        state.update([](appState &s) { s.actions.setConnectedDC(INDEX_SHUT_DOWN); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_AC_DO_NOTHING:
-        actions.setConnectedAC(INDEX_DO_NOTHING);
+        state.update([](appState &s) { s.actions.setConnectedAC(INDEX_DO_NOTHING); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_AC_SLEEP:
-        actions.setConnectedAC(INDEX_SLEEP);
+        state.update([](appState &s) { s.actions.setConnectedAC(INDEX_SLEEP); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_AC_HIBERNATE:
-        actions.setConnectedAC(INDEX_HIBERNATE);
+        state.update([](appState &s) { s.actions.setConnectedAC(INDEX_HIBERNATE); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_CONNECTED_AC_SHUT_DOWN:
-        actions.setConnectedAC(INDEX_SHUT_DOWN);
+        state.update([](appState &s) { s.actions.setConnectedAC(INDEX_SHUT_DOWN); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_DC_DO_NOTHING:
-        actions.setDisconnectedDC(INDEX_DO_NOTHING);
+        state.update([](appState &s) { s.actions.setDisconnectedDC(INDEX_DO_NOTHING); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_DC_SLEEP:
-        actions.setDisconnectedDC(INDEX_SLEEP);
+        state.update([](appState &s) { s.actions.setDisconnectedDC(INDEX_SLEEP); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_DC_HIBERNATE:
-        actions.setDisconnectedDC(INDEX_HIBERNATE);
+        state.update([](appState &s) { s.actions.setDisconnectedDC(INDEX_HIBERNATE); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_DC_SHUT_DOWN:
-        actions.setDisconnectedDC(INDEX_SHUT_DOWN);
+        state.update([](appState &s) { s.actions.setDisconnectedDC(INDEX_SHUT_DOWN); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_AC_DO_NOTHING:
-        actions.setDisconnectedAC(INDEX_DO_NOTHING);
+        state.update([](appState &s) { s.actions.setDisconnectedAC(INDEX_DO_NOTHING); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_AC_SLEEP:
-        actions.setDisconnectedAC(INDEX_SLEEP);
+        state.update([](appState &s) { s.actions.setDisconnectedAC(INDEX_SLEEP); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     case ID_MONITOR_DISCONNECTED_AC_HIBERNATE:
-        actions.setDisconnectedAC(INDEX_HIBERNATE);
-        writeConfig();
+        state.update([](appState &s) { s.actions.setDisconnectedAC(INDEX_HIBERNATE); });
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
     case ID_MONITOR_DISCONNECTED_AC_SHUT_DOWN:
-        actions.setDisconnectedAC(INDEX_SHUT_DOWN);
+        state.update([](appState &s) { s.actions.setDisconnectedAC(INDEX_SHUT_DOWN); });
         applyDisplayConnectivity();
-        writeConfig();
+        armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
         break;
     default:
+        if (cmd >= ID_LANGUAGE_FIRST && cmd <= ID_LANGUAGE_LAST) {
+            const int language = (int)(cmd - ID_LANGUAGE_FIRST);
+            state.update([=](appState &s) { s.language = language; });
+            setUiLanguage(language);
+            // The tooltip of the notification icon is in the old language.
+            removeNotification(hwnd);
+            showNotification(hwnd, true);
+            armTimer(hwnd, WAKEUP_CONFIG_FLUSH, CONFIG_FLUSH_DELAY);
+        }
         break;
     }
     if (ret != ERROR_SUCCESS) {
@@ -719,6 +1706,8 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     switch (msg) {
     case UM_NOTIFY:
         if (lParam == WM_LBUTTONUP || lParam == WM_RBUTTONUP) {
+            traceSummary();
+            refreshPolicy(hwnd);
             SetForegroundWindow(hwnd);
             HMENU menu = createNotifyPopupMenu();
             POINT pt = {0};
@@ -732,25 +1721,89 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             if (cmd != 0) {
                 processNotifyMenuCmd(hwnd, cmd);
             }
+            if (state.load()->lowFootprint) {
+                trimFootprint();
+            }
         }
         return 0;
     case WM_DEVICECHANGE:
-        if (wParam == DBT_DEVNODES_CHANGED) {
-            if (!SetTimer(hwnd, DELAY_DEVICE_CHANGE_TIMER, DEVICE_CHANGE_DELAY, DelayDeviceChangeTimerProc)) {
-                SHOW_LAST_ERROR();
+        if (!session.active()) {
+            break;
+        }
+        switch (wParam) {
+        case DBT_DEVICEARRIVAL:
+        case DBT_DEVICEREMOVECOMPLETE: {
+            wstring instanceId;
+            if (monitorInterfaceInstanceId(lParam, instanceId)) {
+                processMonitorInterfaceChange(hwnd, wParam == DBT_DEVICEARRIVAL, instanceId);
+            }
+            break;
+        }
+        case DBT_DEVNODES_CHANGED:
+            // Fallback for systems not delivering monitor interface notifications.
+            if (!monitorInterfaceNotified) {
+                armTimer(hwnd, WAKEUP_DEVICE_CHANGE, DEVICE_CHANGE_DELAY);
             }
+            break;
         }
         break;
+    case WM_TIMER:
+        if (wParam == DEADLINE_TIMER) {
+            processDeadline(hwnd);
+            return 0;
+        }
+        break;
+    case WM_POWERBROADCAST:
+        if (wParam == PBT_POWERSETTINGCHANGE) {
+            processPowerSupplyChange(lParam);
+            return TRUE;
+        }
+        if (wParam == PBT_APMRESUMEAUTOMATIC) {
+            updateSchedule(hwnd);
+            applyDisplayConnectivity();
+        }
+        break;
+    case WM_TIMECHANGE:
+        updateSchedule(hwnd);
+        applyDisplayConnectivity();
+        break;
+    case WM_WTSSESSION_CHANGE:
+        processSessionChange(hwnd, wParam);
+        return 0;
     case WM_CREATE:
+        mainWindow = hwnd;
+        if (!WTSRegisterSessionNotification(hwnd, NOTIFY_FOR_THIS_SESSION)) {
+            // Without session notifications the instance acts as if it were
+            // always attached to the console.
+            trace(L"Sleepy Lid: no session notification, error %lu\n", GetLastError());
+        }
+        if (!RegisterPowerSupplyNotification(hwnd)) {
+            // The power supply read at start is used from then on.
+            trace(L"Sleepy Lid: no power supply notification, error %lu\n", GetLastError());
+        }
+        updateSchedule(hwnd);
         showNotification(hwnd, silentMode);
         break;
+    case WM_QUERYENDSESSION:
+        // The process may be ended without WM_DESTROY once the session ends.
+        flushConfig(hwnd);
+        return TRUE;
+    case WM_ENDSESSION:
+        if (wParam) {
+            flushConfig(hwnd);
+            traceSummary();
+        }
+        return 0;
     case WM_CLOSE:
         DestroyWindow(hwnd);
         return 0;
     case WM_DESTROY:
         removeNotification(hwnd);
+        WTSUnRegisterSessionNotification(hwnd);
         PostQuitMessage(0);
+        timers.disarm(hwnd, WAKEUP_CONFIG_FLUSH);
         writeConfig();
+        traceSummary();
         return 0;
     }
     return DefWindowProcW(hwnd, msg, wParam, lParam);
@@ -764,17 +1817,38 @@ void showNotification(HWND hwnd, bool silent) {
     data.uFlags = NIF_MESSAGE | NIF_ICON | NIF_TIP | NIF_SHOWTIP;
     if (!silent) {
         data.uFlags |= NIF_INFO;
-        StringCbCopyW(data.szInfo, sizeof(data.szInfo), loadStringRes(STR_RUNNING_IN_SYSTEM_TRAY).c_str());
-        StringCbCopyW(data.szInfoTitle, sizeof(data.szInfoTitle), loadStringRes(STR_APP_NAME).c_str());
+        StringCbCopyW(data.szInfo, sizeof(data.szInfo), loadStringRes(STR_RUNNING_IN_SYSTEM_TRAY));
+        StringCbCopyW(data.szInfoTitle, sizeof(data.szInfoTitle), loadStringRes(STR_APP_NAME));
         data.dwInfoFlags = NIIF_INFO;
     }
     data.uCallbackMessage = UM_NOTIFY;
-    data.hIcon = LoadIconW(GetModuleHandle(NULL), MAKEINTRESOURCEW(ICON_MAIN));
-    StringCchCopyW(data.szTip, sizeof data.szTip / sizeof data.szTip[0], loadStringRes(STR_APP_NAME).c_str());
-    if (!Shell_NotifyIconW(NIM_ADD, &data)) {
+    // Not shared, so that it can be destroyed once the shell has its own copy.
+    data.hIcon = (HICON)LoadImageW(GetModuleHandle(NULL), MAKEINTRESOURCEW(ICON_MAIN),
+                                   IMAGE_ICON, GetSystemMetrics(SM_CXSMICON), GetSystemMetrics(SM_CYSMICON), 0);
+    StringCchCopyW(data.szTip, sizeof data.szTip / sizeof data.szTip[0], loadStringRes(STR_APP_NAME));
+    const BOOL added = Shell_NotifyIconW(NIM_ADD, &data);
+    DestroyIcon(data.hIcon);
+    if (!added) {
         SHOW_LAST_ERROR();
         return;
     }
+    if (state.load()->lowFootprint) {
+        trimFootprint();
+    }
+}
+
+// Trim the working set and measure what is left. Called when going idle in
+// low-footprint mode.
+void trimFootprint() {
+    SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+    PROCESS_MEMORY_COUNTERS_EX counters = {0};
+    counters.cb = sizeof counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PPROCESS_MEMORY_COUNTERS)&counters, sizeof counters)) {
+        trimmedPrivateBytes = counters.PrivateUsage;
+        if (trimmedPrivateBytes > FOOTPRINT_PRIVATE_BUDGET) {
+            overBudgetTrims++;
+        }
+    }
 }
 
 void removeNotification(HWND hwnd) {
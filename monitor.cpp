@@ -1,24 +1,58 @@
 #include <windows.h>
 #include <devguid.h>
 #include <dbt.h>
+#include <cfgmgr32.h>
+#include <cwctype>
 #include "monitor.h"
 
 using namespace std;
 
+// GUID_DEVINTERFACE_MONITOR of ntddvdeo.h.
+// GUID_DEVCLASS_MONITOR is a setup class, not an interface class, and never
+// delivers DBT_DEVICEARRIVAL/DBT_DEVICEREMOVECOMPLETE.
+static const GUID MONITOR_INTERFACE_GUID = {0xe6f07b5f, 0xee97, 0x4a90, {0xb0, 0x76, 0x33, 0xf5, 0x7b, 0xf4, 0xea, 0xa7}};
+
 BOOL RegisterMonitorNotification(HWND hwnd) {
-    DEV_BROADCAST_DEVICEINTERFACE NotificationFilter = {0};
+    DEV_BROADCAST_DEVICEINTERFACE_W NotificationFilter = {0};
 
-    NotificationFilter.dbcc_size = sizeof(DEV_BROADCAST_DEVICEINTERFACE);
+    NotificationFilter.dbcc_size = sizeof(DEV_BROADCAST_DEVICEINTERFACE_W);
     NotificationFilter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
-    NotificationFilter.dbcc_classguid = GUID_DEVCLASS_MONITOR;
+    NotificationFilter.dbcc_classguid = MONITOR_INTERFACE_GUID;
 
-    return RegisterDeviceNotification(
+    return RegisterDeviceNotificationW(
                hwnd,                        // events recipient
                &NotificationFilter,         // type of device
                DEVICE_NOTIFY_WINDOW_HANDLE  // type of recipient handle
                ) != NULL;
 }
 
+// The device interface path looks like:
+// \\?\DISPLAY#DEL40F4#5&2b5e6f3&0&UID4353#{e6f07b5f-ee97-4a90-b076-33f57bf4eaa7}
+// and the device instance id is the part between the prefix and the last '#',
+// with '#' replaced by '\'.
+bool monitorInterfaceInstanceId(LPARAM lParam, wstring& instanceId) {
+    const auto hdr = (const DEV_BROADCAST_HDR*)lParam;
+    if (hdr == NULL || hdr->dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE) {
+        return false;
+    }
+    const auto iface = (const DEV_BROADCAST_DEVICEINTERFACE_W*)hdr;
+    if (!IsEqualGUID(iface->dbcc_classguid, MONITOR_INTERFACE_GUID)) {
+        return false;
+    }
+
+    const wstring path = iface->dbcc_name;
+    const auto begin = path.compare(0, 4, L"\\\\?\\") == 0 ? 4 : 0;
+    const auto end = path.rfind(L'#');
+    if (end == wstring::npos || end <= begin) {
+        return false;
+    }
+    instanceId = path.substr(begin, end - begin);
+    for (auto& c : instanceId) {
+        c = c == L'#' ? L'\\' : towupper(c);
+    }
+    return true;
+}
+
 // https://stackoverflow.com/questions/4958683/how-do-i-get-the-actual-monitor-name-as-seen-in-the-resolution-dialog
 LONG connectedMonitors(vector<wstring>& names) {
     const UINT32 MAX_COUNT = 0xFF;
@@ -52,18 +86,80 @@ LONG connectedMonitors(vector<wstring>& names) {
     return ERROR_SUCCESS;
 }
 
-LONG isExternalMonitorsConnected(bool* connected) {
-    const UINT32 MAX_COUNT = 0xFF;
+// Buffers of queryDisplayConfig. Kept across calls so that the steady state
+// does not allocate, and sized by GetDisplayConfigBufferSizes instead of
+// fixed-size arrays on the stack.
+static vector<DISPLAYCONFIG_PATH_INFO> pathBuffer;
+static vector<DISPLAYCONFIG_MODE_INFO> modeBuffer;
 
-    DISPLAYCONFIG_PATH_INFO pathes[MAX_COUNT];
-    DISPLAYCONFIG_MODE_INFO modes[MAX_COUNT];
-    UINT32 Pathcount = sizeof(pathes) / sizeof(pathes[0]);
-    UINT32 modeCount = sizeof(modes) / sizeof(modes[0]);
+// QueryDisplayConfig into pathBuffer and modeBuffer, which are resized to
+// the number of elements retrieved.
+static LONG queryDisplayConfig(UINT32 flags, DISPLAYCONFIG_TOPOLOGY_ID* id) {
+    LONG ret = ERROR_SUCCESS;
+    do {
+        UINT32 pathCount = 0;
+        UINT32 modeCount = 0;
+        ret = GetDisplayConfigBufferSizes(flags, &pathCount, &modeCount);
+        if (ret != ERROR_SUCCESS) {
+            return ret;
+        }
+        pathBuffer.resize(pathCount);
+        modeBuffer.resize(modeCount);
+        ret = QueryDisplayConfig(flags, &pathCount, pathBuffer.data(), &modeCount, modeBuffer.data(), id);
+        pathBuffer.resize(pathCount);
+        modeBuffer.resize(modeCount);
+    } while (ret == ERROR_INSUFFICIENT_BUFFER);  // Topology changed between the two calls.
+    return ret;
+}
 
+LONG isExternalMonitorsConnected(bool* connected) {
     DISPLAYCONFIG_TOPOLOGY_ID id = DISPLAYCONFIG_TOPOLOGY_INTERNAL;
-    LONG ret = QueryDisplayConfig(QDC_DATABASE_CURRENT, &Pathcount, pathes, &modeCount, modes, &id);
+    LONG ret = queryDisplayConfig(QDC_DATABASE_CURRENT, &id);
     if (ret == ERROR_SUCCESS) {
         *connected = id != DISPLAYCONFIG_TOPOLOGY_INTERNAL;
     }
     return ret;
-}
\ No newline at end of file
+}
+
+// FNV-1a of a byte range, continuing from hash.
+static UINT64 fnv1a(UINT64 hash, const void* data, size_t size) {
+    const BYTE* p = (const BYTE*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Buffer of displayTopologyFingerprint, kept across calls.
+static vector<wchar_t> interfaceBuffer;
+
+LONG displayTopologyFingerprint(UINT64* fingerprint) {
+    // The present monitor interfaces are read from the PnP manager, so that
+    // events of other devices do not cost a display configuration query.
+    CONFIGRET ret = CR_SUCCESS;
+    do {
+        ULONG size = 0;
+        ret = CM_Get_Device_Interface_List_SizeW(&size, (LPGUID)&MONITOR_INTERFACE_GUID, NULL,
+                                                 CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+        if (ret != CR_SUCCESS) {
+            return CM_MapCrToWin32Err(ret, ERROR_GEN_FAILURE);
+        }
+        interfaceBuffer.resize(size);
+        ret = CM_Get_Device_Interface_ListW((LPGUID)&MONITOR_INTERFACE_GUID, NULL, interfaceBuffer.data(), size,
+                                            CM_GET_DEVICE_INTERFACE_LIST_PRESENT);
+    } while (ret == CR_BUFFER_SMALL);  // A monitor arrived between the two calls.
+    if (ret != CR_SUCCESS) {
+        return CM_MapCrToWin32Err(ret, ERROR_GEN_FAILURE);
+    }
+
+    // The list is a sequence of null-terminated interface paths ending with
+    // an empty one. Per-path hashes are summed so that the result does not
+    // depend on the order.
+    UINT64 sum = 0;
+    for (const wchar_t* path = interfaceBuffer.data(); *path != L'\0'; path += wcslen(path) + 1) {
+        sum += fnv1a(0xCBF29CE484222325ULL, path, wcslen(path) * sizeof(wchar_t));
+    }
+    *fingerprint = sum;
+    return ERROR_SUCCESS;
+}
@@ -5,6 +5,14 @@
 LONG connectedMonitors(std::vector<std::wstring> &names);
 // Register the window to receive WM_DEVICE_CHANGED of display devices.
 BOOL RegisterMonitorNotification(HWND hwnd);
+// Retrieve the device instance id(DISPLAY\DEL40F4\5&2B5E6F3&0&UID4353 etc.)
+// of the monitor from lParam of DBT_DEVICEARRIVAL/DBT_DEVICEREMOVECOMPLETE.
+// Returns false if lParam is not a monitor interface notification.
+bool monitorInterfaceInstanceId(LPARAM lParam, std::wstring& instanceId);
 // Retrieve the connectivity of external monitors.
 // If returns ERROR_SUCCESS, *connected is set to the connectivity value.
-LONG isExternalMonitorsConnected(bool* connected);
\ No newline at end of file
+LONG isExternalMonitorsConnected(bool* connected);
+// Compute a 64-bit fingerprint of the display topology from the interface
+// paths of the present monitors. It does not query the display configuration.
+// If returns ERROR_SUCCESS, *fingerprint is set to the fingerprint value.
+LONG displayTopologyFingerprint(UINT64* fingerprint);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "policy.h"
+
+using namespace std;
+
+uint32_t policyChecksum(const void* data, size_t size, uint32_t crc) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= p[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t policyBundleChecksum(const policyHeader* header) {
+    policyHeader unsummed = *header;
+    unsummed.checksum = 0;
+    const uint32_t crc = policyChecksum(&unsummed, sizeof unsummed);
+    return policyChecksum(policyRules(header), header->ruleCount * sizeof(scheduleRule), crc);
+}
+
+static bool validAction(uint8_t action) {
+    return action <= 3;  // INDEX_SHUT_DOWN
+}
+
+const policyHeader* validatePolicy(const void* data, size_t size) {
+    const auto header = (const policyHeader*)data;
+    if (size < sizeof(policyHeader) ||
+        header->magic != POLICY_MAGIC ||
+        header->version != POLICY_VERSION ||
+        header->headerSize != sizeof(policyHeader) ||
+        header->syncMonitor > 1 ||
+        header->lowBatteryPercent > 100 ||
+        !validAction(header->lowBatteryAction)) {
+        return NULL;
+    }
+    if (header->ruleCount > (size - sizeof(policyHeader)) / sizeof(scheduleRule) ||
+        size != sizeof(policyHeader) + header->ruleCount * sizeof(scheduleRule)) {
+        return NULL;
+    }
+    for (const auto action : header->actions) {
+        if (!validAction(action)) {
+            return NULL;
+        }
+    }
+    const auto rules = policyRules(header);
+    if (policyBundleChecksum(header) != header->checksum) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < header->ruleCount; i++) {
+        const auto& rule = rules[i];
+        if (rule.days >= 1 << 7 || rule.start >= MINUTES_PER_DAY || rule.end >= MINUTES_PER_DAY) {
+            return NULL;
+        }
+        for (const auto action : rule.actions) {
+            if (action != SCHEDULE_KEEP_ACTION && !validAction(action)) {
+                return NULL;
+            }
+        }
+    }
+    return header;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "schedule.h"
+
+// A policy bundle is a flat little-endian file made of a policyHeader
+// followed by ruleCount scheduleRule. It is compiled offline from text by
+// tools/policyc and used in place after being mapped into memory.
+const uint32_t POLICY_MAGIC = 0x50594C53;  // "SLYP"
+// 2: the checksum covers the header.
+// 3: the low battery band.
+const uint16_t POLICY_VERSION = 3;
+
+struct policyHeader {
+    uint32_t magic;
+    uint16_t version;
+    // sizeof(policyHeader), where the rules start.
+    uint16_t headerSize;
+    // CRC-32 of the header, with checksum zeroed, followed by the rules.
+    uint32_t checksum;
+    // The meaning of SyncMonitor and MonitorActions of SleepyLid.ini.
+    uint8_t syncMonitor;
+    uint8_t actions[4];
+    // The meaning of LowBatteryPercent and LowBatteryAction of SleepyLid.ini.
+    uint8_t lowBatteryPercent;
+    uint8_t lowBatteryAction;
+    uint8_t reserved;
+    uint32_t ruleCount;
+};
+
+// Returns the header of the bundle of size bytes at data, or NULL if the
+// bundle is malformed, of another version or corrupted.
+const policyHeader* validatePolicy(const void* data, size_t size);
+// The rules following header.
+inline const scheduleRule* policyRules(const policyHeader* header) {
+    return (const scheduleRule*)((const uint8_t*)header + header->headerSize);
+}
+// CRC-32(ISO-HDLC) of size bytes at data, continuing from the CRC of the
+// preceding bytes if any.
+uint32_t policyChecksum(const void* data, size_t size, uint32_t crc = 0);
+// The checksum field of header and the rules following it.
+uint32_t policyBundleChecksum(const policyHeader* header);
@@ -16,10 +16,11 @@ DWORD writeLidCloseActionIndexDC(DWORD index) {
     ret = PowerWriteDCValueIndex(NULL, curPowerScheme,
                                  &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
                                  index);
-    if (ret != ERROR_SUCCESS) {
-        return ret;
+    if (ret == ERROR_SUCCESS) {
+        ret = PowerSetActiveScheme(NULL, curPowerScheme);
     }
-    return PowerSetActiveScheme(NULL, curPowerScheme);
+    LocalFree(curPowerScheme);
+    return ret;
 }
 
 DWORD writeLidCloseActionIndexAC(DWORD index) {
@@ -31,10 +32,11 @@ DWORD writeLidCloseActionIndexAC(DWORD index) {
     ret = PowerWriteACValueIndex(NULL, curPowerScheme,
                                  &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
                                  index);
-    if (ret != ERROR_SUCCESS) {
-        return ret;
+    if (ret == ERROR_SUCCESS) {
+        ret = PowerSetActiveScheme(NULL, curPowerScheme);
     }
-    return PowerSetActiveScheme(NULL, curPowerScheme);
+    LocalFree(curPowerScheme);
+    return ret;
 }
 
 DWORD readLidCloseActionIndexDC(DWORD *index) {
@@ -43,9 +45,11 @@ DWORD readLidCloseActionIndexDC(DWORD *index) {
     if (ret != ERROR_SUCCESS) {
         return ret;
     }
-    return PowerReadDCValueIndex(NULL, curPowerScheme,
-                                 &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
-                                 index);
+    ret = PowerReadDCValueIndex(NULL, curPowerScheme,
+                                &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
+                                index);
+    LocalFree(curPowerScheme);
+    return ret;
 }
 
 DWORD readLidCloseActionIndexAC(DWORD *index) {
@@ -54,7 +58,92 @@ DWORD readLidCloseActionIndexAC(DWORD *index) {
     if (ret != ERROR_SUCCESS) {
         return ret;
     }
-    return PowerReadACValueIndex(NULL, curPowerScheme,
-                                 &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
-                                 index);
+    ret = PowerReadACValueIndex(NULL, curPowerScheme,
+                                &GUID_SYSTEM_BUTTON_SUBGROUP, &GUID_LIDCLOSE_ACTION,
+                                index);
+    LocalFree(curPowerScheme);
+    return ret;
+}
+
+// Power request of setKeepAwakeRequest, created on first use.
+static HANDLE keepAwakeRequest = NULL;
+static bool keepAwakeHeld = false;
+// The request types held by setKeepAwakeRequest.
+static const POWER_REQUEST_TYPE KEEP_AWAKE_REQUEST_TYPES[] = {PowerRequestSystemRequired, PowerRequestAwayModeRequired};
+
+DWORD setKeepAwakeRequest(bool hold) {
+    if (hold == keepAwakeHeld) {
+        return ERROR_SUCCESS;
+    }
+    if (keepAwakeRequest == NULL) {
+        REASON_CONTEXT reason = {0};
+        reason.Version = POWER_REQUEST_CONTEXT_VERSION;
+        reason.Flags = POWER_REQUEST_CONTEXT_SIMPLE_STRING;
+        reason.Reason.SimpleReasonString = (LPWSTR)L"Sleepy Lid: external monitor connected";
+        const HANDLE request = PowerCreateRequest(&reason);
+        if (request == INVALID_HANDLE_VALUE) {
+            return GetLastError();
+        }
+        keepAwakeRequest = request;
+    }
+    for (const auto type : KEEP_AWAKE_REQUEST_TYPES) {
+        if (!(hold ? PowerSetRequest(keepAwakeRequest, type) : PowerClearRequest(keepAwakeRequest, type))) {
+            return GetLastError();
+        }
+    }
+    keepAwakeHeld = hold;
+    return ERROR_SUCCESS;
+}
+
+BOOL RegisterPowerSupplyNotification(HWND hwnd) {
+    return RegisterPowerSettingNotification(hwnd, &GUID_ACDC_POWER_SOURCE, DEVICE_NOTIFY_WINDOW_HANDLE) != NULL &&
+           RegisterPowerSettingNotification(hwnd, &GUID_BATTERY_PERCENTAGE_REMAINING, DEVICE_NOTIFY_WINDOW_HANDLE) != NULL;
+}
+
+bool readPowerSupply(bool *onBattery, DWORD *batteryPercent) {
+    SYSTEM_POWER_STATUS status = {0};
+    if (!GetSystemPowerStatus(&status)) {
+        return false;
+    }
+    *onBattery = status.ACLineStatus == 0;
+    // 255 if unknown.
+    *batteryPercent = status.BatteryLifePercent <= 100 ? status.BatteryLifePercent : 100;
+    return true;
+}
+
+bool updatePowerSupply(LPARAM lParam, bool *onBattery, DWORD *batteryPercent) {
+    const auto setting = (const POWERBROADCAST_SETTING *)lParam;
+    if (setting == NULL || setting->DataLength < sizeof(DWORD)) {
+        return false;
+    }
+    const DWORD value = *(const DWORD *)setting->Data;
+    if (IsEqualGUID(setting->PowerSetting, GUID_ACDC_POWER_SOURCE)) {
+        // PoDc or PoHot(UPS).
+        *onBattery = value != PoAc;
+        return true;
+    }
+    if (IsEqualGUID(setting->PowerSetting, GUID_BATTERY_PERCENTAGE_REMAINING)) {
+        *batteryPercent = value;
+        return true;
+    }
+    return false;
+}
+
+DWORD readAwayModeAllowed(bool dc, bool *allowed) {
+    GUID *curPowerScheme = NULL;
+    DWORD ret = PowerGetActiveScheme(NULL, &curPowerScheme);
+    if (ret != ERROR_SUCCESS) {
+        return ret;
+    }
+    DWORD index = 0;
+    if (dc) {
+        ret = PowerReadDCValueIndex(NULL, curPowerScheme, &GUID_SLEEP_SUBGROUP, &GUID_ALLOW_AWAYMODE, &index);
+    } else {
+        ret = PowerReadACValueIndex(NULL, curPowerScheme, &GUID_SLEEP_SUBGROUP, &GUID_ALLOW_AWAYMODE, &index);
+    }
+    LocalFree(curPowerScheme);
+    if (ret == ERROR_SUCCESS) {
+        *allowed = index != 0;
+    }
+    return ret;
 }
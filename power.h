@@ -13,4 +13,29 @@ DWORD readLidCloseActionIndexAC(DWORD *index);
 DWORD writeLidCloseActionIndexDC(DWORD index);
 // Set the power action of lid closing if AC plugged in.
 // Return value is the error code(ERR_SUCCESS etc.).
-DWORD writeLidCloseActionIndexAC(DWORD index);
\ No newline at end of file
+DWORD writeLidCloseActionIndexAC(DWORD index);
+// Hold(or release if hold is false) a power request keeping the system
+// running while an external monitor is connected, instead of rewriting the
+// power scheme. It asks for away mode, which turns an explicit sleep such as
+// closing the lid into away mode if the power policy allows away mode, see
+// readAwayModeAllowed.
+// The request belongs to the process and is released by the system when the
+// process exits.
+// Return value is the error code(ERROR_SUCCESS etc.).
+DWORD setKeepAwakeRequest(bool hold);
+// Read whether the active scheme allows away mode(GUID_ALLOW_AWAYMODE) on
+// battery if dc is true, otherwise plugged in. It is off by default on
+// laptops, and then the power request does not keep the lid closing awake.
+// Return value is the error code(ERROR_SUCCESS etc.).
+DWORD readAwayModeAllowed(bool dc, bool *allowed);
+// Register the window to receive PBT_POWERSETTINGCHANGE of the power source
+// and the battery percentage. The current values are sent at once.
+BOOL RegisterPowerSupplyNotification(HWND hwnd);
+// Read the power supply once, before any notification is received: whether
+// on battery(or UPS), and the remaining battery percentage, 100 if unknown.
+// Returns false if it can't be read.
+bool readPowerSupply(bool *onBattery, DWORD *batteryPercent);
+// Update the power supply read before from lParam of PBT_POWERSETTINGCHANGE.
+// Only the value notified is changed.
+// Returns false if lParam is not a power supply notification.
+bool updatePowerSupply(LPARAM lParam, bool *onBattery, DWORD *batteryPercent);
@@ -24,3 +24,6 @@
 #define STR_UNKNOWN 219
 #define STR_ALREADY_RUNNING 220
 #define STR_RUNNING_IN_SYSTEM_TRAY 221
+#define STR_LANGUAGE 222
+// The name of the language in itself, for the language menu.
+#define STR_LANGUAGE_NAME 223
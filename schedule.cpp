@@ -0,0 +1,197 @@
+#include "schedule.h"
+
+using namespace std;
+
+// Parse "HH:MM" at str[pos]. 24:00 is accepted as the end of a day.
+static bool parseTime(const wstring& str, size_t pos, uint16_t& minutes) {
+    if (pos + 5 > str.size() || str[pos + 2] != L':') {
+        return false;
+    }
+    int digits[4] = {0};
+    const size_t offsets[4] = {0, 1, 3, 4};
+    for (int i = 0; i < 4; i++) {
+        const wchar_t c = str[pos + offsets[i]];
+        if (c < L'0' || c > L'9') {
+            return false;
+        }
+        digits[i] = c - L'0';
+    }
+    const int hour = digits[0] * 10 + digits[1];
+    const int minute = digits[2] * 10 + digits[3];
+    if (minute >= 60 || hour * 60 + minute > MINUTES_PER_DAY) {
+        return false;
+    }
+    minutes = (uint16_t)((hour * 60 + minute) % MINUTES_PER_DAY);
+    return true;
+}
+
+bool parseScheduleRule(const wstring& str, scheduleRule& rule) {
+    // "1111100 09:00-18:00 00--"
+    //  0       8     14    20
+    if (str.size() != 24 || str[7] != L' ' || str[13] != L'-' || str[19] != L' ') {
+        return false;
+    }
+    scheduleRule temp = {0};
+    for (int i = 0; i < 7; i++) {
+        if (str[i] == L'1') {
+            temp.days |= 1 << i;
+        } else if (str[i] != L'0') {
+            return false;
+        }
+    }
+    if (!parseTime(str, 8, temp.start) || !parseTime(str, 14, temp.end)) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        const wchar_t c = str[20 + i];
+        if (c == L'-') {
+            temp.actions[i] = SCHEDULE_KEEP_ACTION;
+        } else if (c >= L'0' && c <= L'3') {
+            temp.actions[i] = (uint8_t)(c - L'0');
+        } else {
+            return false;
+        }
+    }
+    rule = temp;
+    return true;
+}
+
+wstring scheduleRuleToString(const scheduleRule& rule) {
+    wstring ret(24, L' ');
+    for (int i = 0; i < 7; i++) {
+        ret[i] = (rule.days & (1 << i)) ? L'1' : L'0';
+    }
+    const uint16_t times[2] = {rule.start, rule.end};
+    for (int i = 0; i < 2; i++) {
+        const size_t pos = 8 + i * 6;
+        const int hour = times[i] / 60 % 24;
+        const int minute = times[i] % 60;
+        ret[pos] = L'0' + hour / 10;
+        ret[pos + 1] = L'0' + hour % 10;
+        ret[pos + 2] = L':';
+        ret[pos + 3] = L'0' + minute / 10;
+        ret[pos + 4] = L'0' + minute % 10;
+    }
+    ret[13] = L'-';
+    for (int i = 0; i < 4; i++) {
+        ret[20 + i] = rule.actions[i] == SCHEDULE_KEEP_ACTION ? L'-' : L'0' + rule.actions[i];
+    }
+    return ret;
+}
+
+// Length of rule in minutes. A rule ending at its start lasts a whole day.
+static int duration(const scheduleRule& rule) {
+    return rule.end > rule.start ? rule.end - rule.start : rule.end + MINUTES_PER_DAY - rule.start;
+}
+
+scheduleWheel::scheduleWheel() {
+    reset(NULL, 0);
+}
+
+void scheduleWheel::reset(const scheduleRule* rules, size_t count) {
+    this->rules = rules;
+    ruleCount = count;
+    for (auto& h : hours) {
+        h = 0;
+    }
+    for (auto& m : minutes) {
+        m = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        for (int day = 0; day < 7; day++) {
+            if (!(rules[i].days & (1 << day))) {
+                continue;
+            }
+            const int start = day * MINUTES_PER_DAY + rules[i].start;
+            mark(start);
+            mark((start + duration(rules[i])) % MINUTES_PER_WEEK);
+        }
+    }
+}
+
+void scheduleWheel::mark(int minuteOfWeek) {
+    const int hour = minuteOfWeek / 60;
+    hours[hour / 64] |= 1ULL << (hour % 64);
+    minutes[hour] |= 1ULL << (minuteOfWeek % 60);
+}
+
+// Index of the lowest set bit of v, which must not be 0.
+static int lowestBit(uint64_t v) {
+    int n = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+}
+
+// The first hour in [from, 7 * 24) having transitions, or -1.
+int scheduleWheel::nextHour(int from) const {
+    for (int w = from / 64; w < 3; w++) {
+        uint64_t word = hours[w];
+        if (w == from / 64) {
+            word &= ~0ULL << (from % 64);
+        }
+        if (word != 0) {
+            return w * 64 + lowestBit(word);
+        }
+    }
+    return -1;
+}
+
+// The first transition after minuteOfWeek, wrapping around the week, or -1.
+int scheduleWheel::next(int minuteOfWeek) const {
+    const int hour = minuteOfWeek / 60;
+    const int minute = minuteOfWeek % 60;
+    // Rest of the current hour.
+    const uint64_t rest = minute == 59 ? 0 : minutes[hour] & (~0ULL << (minute + 1));
+    if (rest != 0) {
+        return hour * 60 + lowestBit(rest);
+    }
+    int h = hour + 1 < 7 * 24 ? nextHour(hour + 1) : -1;
+    if (h < 0) {
+        // Wrap around, up to the current hour of the next week.
+        h = nextHour(0);
+    }
+    if (h < 0) {
+        return -1;
+    }
+    return h * 60 + lowestBit(minutes[h]);
+}
+
+int scheduleWheel::advance(int minuteOfWeek, scheduleOverlay& overlay) const {
+    overlay = scheduleOverlay();
+    // Later rules take precedence.
+    for (size_t i = 0; i < ruleCount; i++) {
+        const auto& rule = rules[i];
+        for (int day = 0; day < 7; day++) {
+            if (!(rule.days & (1 << day))) {
+                continue;
+            }
+            const int start = day * MINUTES_PER_DAY + rule.start;
+            if ((minuteOfWeek - start + MINUTES_PER_WEEK) % MINUTES_PER_WEEK >= duration(rule)) {
+                continue;
+            }
+            for (int slot = 0; slot < 4; slot++) {
+                if (rule.actions[slot] != SCHEDULE_KEEP_ACTION) {
+                    overlay.actions[slot] = rule.actions[slot];
+                }
+            }
+        }
+    }
+    const int n = next(minuteOfWeek);
+    if (n < 0) {
+        return -1;
+    }
+    const int minutesUntil = (n - minuteOfWeek + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+    return minutesUntil == 0 ? MINUTES_PER_WEEK : minutesUntil;
+}
+
+bool scheduleOverlay::active() const {
+    for (const auto a : actions) {
+        if (a != SCHEDULE_KEEP_ACTION) {
+            return true;
+        }
+    }
+    return false;
+}
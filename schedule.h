@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minutes of a day and of a week.
+const int MINUTES_PER_DAY = 24 * 60;
+const int MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+
+// Value of scheduleRule::actions meaning the action is not overridden.
+const uint8_t SCHEDULE_KEEP_ACTION = 0xFF;
+
+// A weekly time-of-day rule overriding the monitor actions while active.
+// Plain data, so that rules can be stored and used as is in binary form.
+struct scheduleRule {
+    // Days of week on which the rule starts. Bit 0 is Monday.
+    uint8_t days;
+    uint8_t reserved;
+    // Start and end, in minutes since midnight. If end is not greater than
+    // start, the rule ends on the next day.
+    uint16_t start;
+    uint16_t end;
+    // Actions in the order of MonitorActions(connected DC, connected AC,
+    // disconnected DC, disconnected AC), or SCHEDULE_KEEP_ACTION.
+    uint8_t actions[4];
+};
+
+// Parse a rule like "1111100 09:00-18:00 00--":
+// days from Monday to Sunday, time range, and actions in the order of
+// MonitorActions where '-' keeps the action.
+// Returns false if str is malformed.
+bool parseScheduleRule(const std::wstring& str, scheduleRule& rule);
+// The reverse of parseScheduleRule.
+std::wstring scheduleRuleToString(const scheduleRule& rule);
+
+// Actions overridden by the rules in effect at some time.
+struct scheduleOverlay {
+    uint8_t actions[4] = {SCHEDULE_KEEP_ACTION, SCHEDULE_KEEP_ACTION, SCHEDULE_KEEP_ACTION, SCHEDULE_KEEP_ACTION};
+
+    // The action of slot(index in MonitorActions order), or base if no rule
+    // overrides it.
+    int action(int slot, int base) const {
+        return actions[slot] == SCHEDULE_KEEP_ACTION ? base : actions[slot];
+    }
+    // Whether any action is overridden.
+    bool active() const;
+};
+
+// Transitions of schedule rules on a two-level timer wheel: the hours of a
+// week, and the minutes of each hour. Finding the next transition never
+// scans more than a few words, and the overlay is computed only when a
+// transition is reached, so looking actions up is O(1).
+// Immutable once reset, so it can be shared across threads.
+class scheduleWheel {
+public:
+    scheduleWheel();
+    // Replace the rules. rules must outlive the wheel or the next reset.
+    void reset(const scheduleRule* rules, size_t count);
+    // Compute the overlay at minuteOfWeek(0 is Monday 00:00).
+    // Returns the minutes until the next transition, or -1 if there is none.
+    int advance(int minuteOfWeek, scheduleOverlay& overlay) const;
+
+private:
+    void mark(int minuteOfWeek);
+    int nextHour(int from) const;
+    int next(int minuteOfWeek) const;
+
+    const scheduleRule* rules;
+    size_t ruleCount;
+    // Bit h of hours is set if hour h of the week has any transition.
+    uint64_t hours[3];
+    // Bit m of minutes[h] is set if minute m of hour h has a transition.
+    uint64_t minutes[7 * 24];
+};
@@ -0,0 +1,17 @@
+#include "session.h"
+
+sessionTransition sessionSwitch::update(unsigned event) {
+    if (event != SESSION_CONSOLE_CONNECT && event != SESSION_CONSOLE_DISCONNECT) {
+        return SESSION_UNCHANGED;
+    }
+    const bool connected = event == SESSION_CONSOLE_CONNECT;
+    if (connected == console) {
+        return SESSION_UNCHANGED;
+    }
+    console = connected;
+    if (!connected) {
+        return SESSION_DORMANT;
+    }
+    activations++;
+    return SESSION_ACTIVATED;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Session change events, the values of WM_WTSSESSION_CHANGE(WTS_*).
+enum sessionEvent {
+    SESSION_CONSOLE_CONNECT = 0x1,
+    SESSION_CONSOLE_DISCONNECT = 0x2,
+};
+
+// What an instance does on a session change.
+enum sessionTransition {
+    SESSION_UNCHANGED = 0,
+    // The session got the console: apply from now on.
+    SESSION_ACTIVATED,
+    // The session lost the console: stop applying and stay idle.
+    SESSION_DORMANT,
+};
+
+// Whether the instance of a session applies the lid closing actions. Each
+// session runs its own instance, but the lid and the power scheme belong to
+// the machine, so only the instance of the session attached to the physical
+// console applies them. Events of other kinds, and repeated ones, are
+// ignored.
+class sessionSwitch {
+public:
+    // console is whether the session is attached to the console at start.
+    explicit sessionSwitch(bool console) : console(console), activations(0) {}
+    // Process a WM_WTSSESSION_CHANGE event of this session.
+    sessionTransition update(unsigned event);
+    bool active() const {
+        return console;
+    }
+    // Number of times the session got the console back.
+    unsigned activationCount() const {
+        return activations;
+    }
+
+private:
+    bool console;
+    unsigned activations;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+
+// A value of T shared across threads as immutable snapshots. Readers get a
+// consistent snapshot with load and keep it as long as they need; writers
+// publish a modified copy with update, swapping the pointer atomically. A
+// snapshot is reclaimed when the last reader holding it drops it.
+// The atomic shared_ptr functions are not lock-free: MSVC takes a global
+// spinlock and libstdc++ a mutex of a small pool, held only while the pointer
+// is copied or swapped. Readers never wait on a writer's copy of T.
+template <class T>
+class snapshot {
+public:
+    snapshot() : current(std::make_shared<T>()) {}
+
+    std::shared_ptr<const T> load() const {
+        return std::atomic_load(&current);
+    }
+
+    // Publish a copy of the current value modified by modify(T&), and return
+    // it. If another writer publishes first, modify is applied again to the
+    // copy of its value, so it must not have side effects.
+    template <class F>
+    std::shared_ptr<const T> update(F modify) {
+        std::shared_ptr<const T> expected = load();
+        for (;;) {
+            auto next = std::make_shared<T>(*expected);
+            modify(*next);
+            std::shared_ptr<const T> desired = std::move(next);
+            if (std::atomic_compare_exchange_strong(&current, &expected, desired)) {
+                return desired;
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<const T> current;
+};
@@ -0,0 +1,60 @@
+// Tests of the power bands and their hysteresis.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. band_test.cpp ../band.cpp -o band_test
+#include <initializer_list>
+
+#include "check.h"
+#include "band.h"
+
+static void testBands() {
+    CHECK(powerBand(false, 5, 20, POWER_BAND_DC_LOW) == POWER_BAND_AC);
+    CHECK(powerBand(true, 50, 20, POWER_BAND_AC) == POWER_BAND_DC);
+    CHECK(powerBand(true, 19, 20, POWER_BAND_DC) == POWER_BAND_DC_LOW);
+    CHECK(powerBand(true, 20, 20, POWER_BAND_DC) == POWER_BAND_DC);
+    // Disabled.
+    CHECK(powerBand(true, 0, 0, POWER_BAND_DC) == POWER_BAND_DC);
+    CHECK(powerBand(true, 0, 0, POWER_BAND_DC_LOW) == POWER_BAND_DC);
+    // Unplugged while already low.
+    CHECK(powerBand(true, 10, 20, POWER_BAND_AC) == POWER_BAND_DC_LOW);
+}
+
+static void testHysteresis() {
+    // Entering the low band is immediate, leaving it takes
+    // POWER_BAND_HYSTERESIS percents more.
+    CHECK(powerBand(true, 19, 20, POWER_BAND_DC) == POWER_BAND_DC_LOW);
+    CHECK(powerBand(true, 20, 20, POWER_BAND_DC_LOW) == POWER_BAND_DC_LOW);
+    CHECK(powerBand(true, 20 + POWER_BAND_HYSTERESIS - 1, 20, POWER_BAND_DC_LOW) == POWER_BAND_DC_LOW);
+    CHECK(powerBand(true, 20 + POWER_BAND_HYSTERESIS, 20, POWER_BAND_DC_LOW) == POWER_BAND_DC);
+    // Plugging in leaves it at once.
+    CHECK(powerBand(false, 19, 20, POWER_BAND_DC_LOW) == POWER_BAND_AC);
+}
+
+// A battery draining from 100% with readings jittering by one percent, as
+// processPowerSupplyChange sees them: the band changes, and the lid closing
+// is applied, once when crossing the threshold.
+static void testCrossings() {
+    uint8_t band = powerBand(true, 100, 20, POWER_BAND_AC);
+    CHECK(band == POWER_BAND_DC);
+    int crossings = 0;
+    for (int percent = 100; percent >= 0; percent--) {
+        for (const int reading : {percent, percent + 1, percent}) {
+            const uint8_t next = powerBand(true, reading, 20, band);
+            crossings += next != band;
+            band = next;
+        }
+    }
+    CHECK(band == POWER_BAND_DC_LOW);
+    CHECK(crossings == 1);
+    // Charging on AC, then unplugged again above the threshold.
+    band = powerBand(false, 30, 20, band);
+    CHECK(band == POWER_BAND_AC);
+    CHECK(powerBand(true, 30, 20, band) == POWER_BAND_DC);
+}
+
+int main() {
+    testBands();
+    testHysteresis();
+    testCrossings();
+    return failures != 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdio>
+
+// Checks of the unit tests. A failed check is reported and counted, and main
+// returns whether any failed.
+static int failures = 0;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
@@ -0,0 +1,103 @@
+// Tests of the deadline timer on a virtual clock.
+//
+// Portable, build on Linux with a fake windows.h:
+//   g++ -std=c++14 -I.. -Iwin32 deadline_test.cpp ../deadline.cpp -o deadline_test
+#include "check.h"
+#include "deadline.h"
+
+static ULONGLONG virtualNow = 0;
+
+static ULONGLONG WINAPI virtualClock() {
+    return virtualNow;
+}
+
+static const UINT_PTR TIMER_ID = 7;
+static const HWND hwnd = nullptr;
+
+static void testCoalescing() {
+    virtualNow = 1000;
+    fakeTimer() = fakeWindowTimer();
+    deadlineTimer timer(TIMER_ID, virtualClock);
+
+    // Idle: no timer.
+    CHECK(timer.expire(hwnd) == 0);
+    CHECK(timer.spuriousWakeups() == 1);
+    CHECK(!fakeTimer().set);
+
+    CHECK(timer.arm(hwnd, WAKEUP_CONFIG_FLUSH, 5000) == ERROR_SUCCESS);
+    CHECK(fakeTimer().set && fakeTimer().id == TIMER_ID && fakeTimer().elapse == 5000);
+    // A later deadline leaves the timer as is.
+    timer.arm(hwnd, WAKEUP_DEVICE_CHANGE, 60000);
+    CHECK(fakeTimer().sets == 1);
+    // An earlier one moves it.
+    virtualNow += 1000;
+    timer.arm(hwnd, WAKEUP_DEVICE_CHANGE, 500);
+    CHECK(fakeTimer().elapse == 500);
+    CHECK(timer.armed(WAKEUP_DEVICE_CHANGE));
+
+    // Early: nothing is due.
+    virtualNow += 499;
+    CHECK(timer.expire(hwnd) == 0);
+    CHECK(timer.spuriousWakeups() == 2);
+    CHECK(fakeTimer().elapse == 1);
+    virtualNow += 1;
+    CHECK(timer.expire(hwnd) == 1u << WAKEUP_DEVICE_CHANGE);
+    CHECK(!timer.armed(WAKEUP_DEVICE_CHANGE));
+    CHECK(timer.wakeups(WAKEUP_DEVICE_CHANGE) == 1);
+    // Set to the next deadline, the config flush at 6000.
+    CHECK(fakeTimer().set && fakeTimer().elapse == 3500);
+
+    // Late: every cause due by now expires in one wakeup, and the timer is
+    // killed as nothing is pending.
+    timer.arm(hwnd, WAKEUP_DEVICE_CHANGE, 2000);
+    virtualNow = 10000;
+    CHECK(timer.expire(hwnd) == ((1u << WAKEUP_CONFIG_FLUSH) | (1u << WAKEUP_DEVICE_CHANGE)));
+    CHECK(timer.wakeups(WAKEUP_CONFIG_FLUSH) == 1 && timer.wakeups(WAKEUP_DEVICE_CHANGE) == 2);
+    CHECK(!fakeTimer().set);
+
+    // Disarming the last deadline kills the timer too.
+    timer.arm(hwnd, WAKEUP_CONFIG_FLUSH, 1000);
+    CHECK(fakeTimer().set);
+    timer.disarm(hwnd, WAKEUP_CONFIG_FLUSH);
+    CHECK(!fakeTimer().set);
+    CHECK(timer.wakeups(WAKEUP_CONFIG_FLUSH) == 1);
+}
+
+static void testReplaceAndClamp() {
+    virtualNow = 0;
+    fakeTimer() = fakeWindowTimer();
+    deadlineTimer timer(TIMER_ID, virtualClock);
+
+    // Rearming a cause replaces its deadline.
+    timer.arm(hwnd, WAKEUP_DEVICE_CHANGE, 500);
+    timer.arm(hwnd, WAKEUP_DEVICE_CHANGE, 2000);
+    CHECK(fakeTimer().elapse == 2000);
+    virtualNow = 500;
+    CHECK(timer.expire(hwnd) == 0);
+
+    // A deadline already passed fires as soon as possible.
+    timer.arm(hwnd, WAKEUP_CONFIG_FLUSH, 0);
+    CHECK(fakeTimer().elapse == USER_TIMER_MINIMUM);
+    virtualNow = 2000;
+    CHECK(timer.expire(hwnd) == ((1u << WAKEUP_DEVICE_CHANGE) | (1u << WAKEUP_CONFIG_FLUSH)));
+    CHECK(!fakeTimer().set);
+
+    // The window timer is clamped to USER_TIMER_MAXIMUM.
+    timer.arm(hwnd, WAKEUP_CONFIG_FLUSH, 0xFFFFFFFF);
+    CHECK(fakeTimer().elapse == USER_TIMER_MAXIMUM);
+    virtualNow += USER_TIMER_MAXIMUM;
+    CHECK(timer.expire(hwnd) == 0);
+    CHECK(fakeTimer().elapse == USER_TIMER_MAXIMUM);
+    virtualNow += USER_TIMER_MAXIMUM;
+    CHECK(timer.expire(hwnd) == 0);
+    CHECK(fakeTimer().elapse == 1);
+    virtualNow += 1;
+    CHECK(timer.expire(hwnd) == 1u << WAKEUP_CONFIG_FLUSH);
+    CHECK(!fakeTimer().set);
+}
+
+int main() {
+    testCoalescing();
+    testReplaceAndClamp();
+    return failures != 0;
+}
@@ -0,0 +1,112 @@
+// Tests of the flap detector and the token bucket.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. flap_test.cpp ../flap.cpp -o flap_test
+#include "check.h"
+#include "flap.h"
+
+static void testFlapping() {
+    flapDetector flap(3, 1000, 5000);
+    // The first state observed is not a transition.
+    CHECK(flap.update(true, 0));
+    CHECK(!flap.update(false, 100));
+    CHECK(flap.update(true, 200));
+    CHECK(!flap.flapping());
+    // The third transition within the window: "connected" is pinned.
+    CHECK(flap.update(false, 300));
+    CHECK(flap.flapping());
+    CHECK(flap.flaps() == 1);
+    CHECK(flap.settleTime() == 5300);
+    CHECK(flap.update(false, 5299));
+    // Settled.
+    CHECK(!flap.update(false, 5300));
+    CHECK(!flap.flapping());
+    CHECK(flap.flaps() == 1);
+    // The transitions before settling are forgotten.
+    CHECK(flap.update(true, 5400));
+    CHECK(!flap.update(false, 5500));
+    CHECK(!flap.flapping());
+}
+
+static void testSettleExtended() {
+    flapDetector flap(2, 1000, 5000);
+    flap.update(true, 0);
+    flap.update(false, 100);
+    CHECK(flap.update(true, 200));
+    CHECK(flap.flapping());
+    // Each transition while flapping postpones settling.
+    CHECK(flap.update(false, 4000));
+    CHECK(flap.settleTime() == 9000);
+    CHECK(flap.update(false, 8999));
+    CHECK(!flap.update(false, 9000));
+    // Flapping again counts another flap.
+    flap.update(true, 9100);
+    CHECK(flap.update(false, 9200));
+    CHECK(flap.flaps() == 2);
+}
+
+static void testSlowTransitions() {
+    flapDetector flap(3, 1000, 5000);
+    flap.update(true, 0);
+    CHECK(!flap.update(false, 600));
+    CHECK(flap.update(true, 1200));
+    CHECK(!flap.update(false, 1800));
+    CHECK(flap.update(true, 2400));
+    CHECK(!flap.flapping());
+    CHECK(flap.flaps() == 0);
+    // Repeating the same state is not a transition.
+    for (int i = 0; i < 10; i++) {
+        CHECK(flap.update(true, 2500 + i));
+    }
+    CHECK(!flap.flapping());
+}
+
+static void testThresholdClamped() {
+    flapDetector one(0, 1000, 5000);
+    one.update(false, 0);
+    CHECK(one.update(true, 10));
+    CHECK(one.flapping());
+
+    flapDetector many(100, 1000, 5000);
+    bool connected = true;
+    for (int i = 0; i < flapDetector::MAX_THRESHOLD; i++) {
+        many.update(connected, i);
+        connected = !connected;
+    }
+    CHECK(!many.flapping());
+    many.update(connected, flapDetector::MAX_THRESHOLD);
+    CHECK(many.flapping());
+}
+
+static void testTokenBucket() {
+    tokenBucket bucket(2, 1000);
+    // A full bucket allows a burst of capacity.
+    CHECK(bucket.wait(0) == 0);
+    CHECK(bucket.take(0));
+    CHECK(bucket.take(0));
+    CHECK(!bucket.take(0));
+    CHECK(bucket.denials() == 1);
+    CHECK(bucket.wait(0) == 1000);
+    CHECK(bucket.wait(999) == 1);
+    // One token every interval.
+    CHECK(bucket.take(1000));
+    CHECK(!bucket.take(1500));
+    CHECK(bucket.wait(1500) == 500);
+    CHECK(bucket.take(2000));
+    CHECK(bucket.denials() == 2);
+    // Refilled up to capacity only.
+    CHECK(bucket.take(10000));
+    CHECK(bucket.take(10000));
+    CHECK(!bucket.take(10000));
+    CHECK(bucket.wait(10000) == 1000);
+    CHECK(bucket.denials() == 3);
+}
+
+int main() {
+    testFlapping();
+    testSettleExtended();
+    testSlowTransitions();
+    testThresholdClamped();
+    testTokenBucket();
+    return failures != 0;
+}
@@ -0,0 +1,81 @@
+// Tests of the footprint budget of the state kept resident all day: its size,
+// and no heap allocation in the steady state of event handling.
+//
+// Portable, build on Linux with a fake windows.h:
+//   g++ -std=c++14 -I.. -Iwin32 footprint_test.cpp ../deadline.cpp ../flap.cpp ../schedule.cpp -o footprint_test
+#include <cstdlib>
+#include <new>
+
+#include "check.h"
+#include "deadline.h"
+#include "flap.h"
+#include "schedule.h"
+
+// Bytes of the resident event handling state: the deadline timer, the flap
+// detector, the rate limit of power scheme writes and the schedule wheel.
+static const size_t RESIDENT_STATE_BUDGET = 2048;
+
+// Number of heap allocations so far.
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static ULONGLONG virtualNow = 0;
+
+static ULONGLONG WINAPI virtualClock() {
+    return virtualNow;
+}
+
+static void testResidentSize() {
+    const size_t size = sizeof(deadlineTimer) + sizeof(flapDetector) + sizeof(tokenBucket) +
+                        sizeof(scheduleWheel) + sizeof(scheduleOverlay);
+    fprintf(stderr, "resident state: %zu bytes\n", size);
+    CHECK(size <= RESIDENT_STATE_BUDGET);
+}
+
+// A day of events: device changes, config flushes, flaps and schedule
+// transitions. None of them allocates once the rules are loaded.
+static void testSteadyStateAllocations() {
+    scheduleRule rules[2] = {};
+    CHECK(parseScheduleRule(L"1111100 09:00-18:00 00--", rules[0]));
+    CHECK(parseScheduleRule(L"0000011 22:00-06:00 --11", rules[1]));
+    scheduleWheel wheel;
+    wheel.reset(rules, 2);
+    deadlineTimer timers(1, virtualClock);
+    flapDetector flap(4, 10000, 30000);
+    tokenBucket writes(3, 10000);
+    scheduleOverlay overlay;
+
+    const size_t before = allocations;
+    for (int minute = 0; minute < MINUTES_PER_DAY; minute++) {
+        virtualNow = (ULONGLONG)minute * 60000;
+        timers.arm(nullptr, WAKEUP_DEVICE_CHANGE, 3000);
+        timers.arm(nullptr, WAKEUP_CONFIG_FLUSH, 2000);
+        virtualNow += 3000;
+        timers.expire(nullptr);
+        flap.update(minute % 3 != 0, virtualNow);
+        writes.take(virtualNow);
+        wheel.advance(minute, overlay);
+    }
+    CHECK(allocations == before);
+}
+
+int main() {
+    testResidentSize();
+    testSteadyStateAllocations();
+    return failures != 0;
+}
@@ -0,0 +1,181 @@
+// Tests of the validation of policy bundles.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. policy_test.cpp ../policy.cpp ../schedule.cpp -o policy_test
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "policy.h"
+
+using namespace std;
+
+// Header of data, which is kept 4-byte aligned by vector.
+static policyHeader* header(vector<uint8_t>& data) {
+    return (policyHeader*)data.data();
+}
+
+// Update the checksum after data was changed, so that only the change is
+// rejected.
+static void resign(vector<uint8_t>& data) {
+    header(data)->checksum = policyBundleChecksum(header(data));
+}
+
+// A valid bundle of two rules, as tools/policyc writes it.
+static vector<uint8_t> bundle() {
+    scheduleRule rules[2] = {};
+    CHECK(parseScheduleRule(L"1111100 09:00-18:00 00--", rules[0]));
+    CHECK(parseScheduleRule(L"0000011 22:00-06:00 --11", rules[1]));
+    policyHeader header = {};
+    header.magic = POLICY_MAGIC;
+    header.version = POLICY_VERSION;
+    header.headerSize = sizeof header;
+    header.syncMonitor = 1;
+    header.actions[0] = 0;
+    header.actions[1] = 1;
+    header.actions[2] = 1;
+    header.actions[3] = 1;
+    header.lowBatteryPercent = 10;
+    header.lowBatteryAction = 2;
+    header.ruleCount = 2;
+    vector<uint8_t> data(sizeof header + sizeof rules);
+    memcpy(data.data(), &header, sizeof header);
+    memcpy(data.data() + sizeof header, rules, sizeof rules);
+    resign(data);
+    return data;
+}
+
+static bool valid(const vector<uint8_t>& data) {
+    return validatePolicy(data.data(), data.size()) == (const policyHeader*)data.data();
+}
+
+static void testValid() {
+    auto data = bundle();
+    CHECK(valid(data));
+    CHECK(policyRules(header(data))[1].start == 22 * 60);
+}
+
+static void testTruncated() {
+    auto data = bundle();
+    // Shorter than a header.
+    for (size_t size = 0; size < sizeof(policyHeader); size++) {
+        CHECK(validatePolicy(data.data(), size) == NULL);
+    }
+    // A rule cut off, or one missing.
+    CHECK(validatePolicy(data.data(), data.size() - 1) == NULL);
+    CHECK(validatePolicy(data.data(), data.size() - sizeof(scheduleRule)) == NULL);
+    // Trailing bytes.
+    data.push_back(0);
+    CHECK(!valid(data));
+}
+
+static void testMagicAndVersion() {
+    auto data = bundle();
+    header(data)->magic ^= 1;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    header(data)->version = POLICY_VERSION - 1;
+    resign(data);
+    CHECK(!valid(data));
+
+    // Not resigned: the rules would be looked for past the end.
+    data = bundle();
+    header(data)->headerSize = sizeof(policyHeader) + sizeof(scheduleRule);
+    CHECK(!valid(data));
+}
+
+static void testChecksum() {
+    const auto good = bundle();
+    // Any flipped byte of the header or the rules, the checksum itself
+    // included, is detected.
+    for (size_t i = 0; i < good.size(); i++) {
+        auto data = good;
+        data[i] ^= 0x01;
+        CHECK(!valid(data));
+    }
+}
+
+static void testRuleCount() {
+    auto data = bundle();
+    // Not resigned: the checksum of rules past the end can't be computed.
+    // The count is checked first, so nothing past the end is read either.
+    for (const uint32_t count : {3u, 0x10000000u, 0xFFFFFFFFu}) {
+        header(data)->ruleCount = count;
+        CHECK(!valid(data));
+    }
+    // Fewer rules than the file holds.
+    header(data)->ruleCount = 1;
+    resign(data);
+    CHECK(!valid(data));
+}
+
+static void testMinutes() {
+    auto data = bundle();
+    auto rules = (scheduleRule*)(data.data() + sizeof(policyHeader));
+    rules[1].start = MINUTES_PER_DAY;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    rules = (scheduleRule*)(data.data() + sizeof(policyHeader));
+    rules[0].end = 0xFFFF;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    rules = (scheduleRule*)(data.data() + sizeof(policyHeader));
+    rules[0].end = MINUTES_PER_DAY - 1;
+    resign(data);
+    CHECK(valid(data));
+}
+
+// Actions, and the low battery band.
+static void testActions() {
+    auto data = bundle();
+    header(data)->actions[2] = 4;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    header(data)->syncMonitor = 2;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    header(data)->lowBatteryAction = 4;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    header(data)->lowBatteryPercent = 101;
+    resign(data);
+    CHECK(!valid(data));
+    header(data)->lowBatteryPercent = 100;
+    resign(data);
+    CHECK(valid(data));
+
+    data = bundle();
+    auto rules = (scheduleRule*)(data.data() + sizeof(policyHeader));
+    rules[0].actions[3] = 4;
+    resign(data);
+    CHECK(!valid(data));
+
+    data = bundle();
+    rules = (scheduleRule*)(data.data() + sizeof(policyHeader));
+    rules[0].days = 1 << 7;
+    resign(data);
+    CHECK(!valid(data));
+}
+
+int main() {
+    testValid();
+    testTruncated();
+    testMagicAndVersion();
+    testChecksum();
+    testRuleCount();
+    testMinutes();
+    testActions();
+    return failures != 0;
+}
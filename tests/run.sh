@@ -0,0 +1,23 @@
+#!/bin/sh
+# Build and run the unit tests of the portable code on Linux.
+set -e
+cd "$(dirname "$0")"
+out=${TMPDIR:-/tmp}/sleepylid-tests
+mkdir -p "$out"
+
+run() {
+    name=$1
+    shift
+    g++ -std=c++14 -Wall -pthread -I.. "$@" -o "$out/$name"
+    "$out/$name"
+    echo "$name: ok"
+}
+
+run deadline_test -Iwin32 deadline_test.cpp ../deadline.cpp
+run schedule_test schedule_test.cpp ../schedule.cpp
+run flap_test flap_test.cpp ../flap.cpp
+run snapshot_test snapshot_test.cpp
+run footprint_test -Iwin32 footprint_test.cpp ../deadline.cpp ../flap.cpp ../schedule.cpp
+run policy_test policy_test.cpp ../policy.cpp ../schedule.cpp
+run session_test session_test.cpp ../session.cpp
+run band_test band_test.cpp ../band.cpp
@@ -0,0 +1,148 @@
+// Tests of the schedule rules and the schedule wheel.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. schedule_test.cpp ../schedule.cpp -o schedule_test
+#include "check.h"
+#include "schedule.h"
+
+using namespace std;
+
+static int minuteOfWeek(int day, int hour, int minute) {
+    return day * MINUTES_PER_DAY + hour * 60 + minute;
+}
+
+static scheduleRule rule(const wchar_t* str) {
+    scheduleRule r = {0};
+    CHECK(parseScheduleRule(str, r));
+    return r;
+}
+
+static void testParse() {
+    scheduleRule r;
+    const wstring str = L"1111100 09:00-18:00 01-3";
+    CHECK(parseScheduleRule(str, r));
+    CHECK(r.days == 0x1F);
+    CHECK(r.start == 9 * 60 && r.end == 18 * 60);
+    CHECK(r.actions[0] == 0 && r.actions[1] == 1);
+    CHECK(r.actions[2] == SCHEDULE_KEEP_ACTION && r.actions[3] == 3);
+    CHECK(scheduleRuleToString(r) == str);
+
+    // 24:00 is the end of a day.
+    CHECK(parseScheduleRule(L"0000001 00:00-24:00 ----", r));
+    CHECK(r.start == 0 && r.end == 0);
+
+    CHECK(!parseScheduleRule(L"1111100 09:00-18:00 01-", r));
+    CHECK(!parseScheduleRule(L"1111102 09:00-18:00 01--", r));
+    CHECK(!parseScheduleRule(L"1111100 09:60-18:00 01--", r));
+    CHECK(!parseScheduleRule(L"1111100 09:00-24:01 01--", r));
+    CHECK(!parseScheduleRule(L"1111100 09:00-18:00 04--", r));
+}
+
+static void testEmpty() {
+    scheduleWheel wheel;
+    scheduleOverlay overlay;
+    CHECK(wheel.advance(0, overlay) == -1);
+    CHECK(!overlay.active());
+    CHECK(overlay.action(0, 2) == 2);
+}
+
+// A rule of Sunday night wraps around the week to Monday morning.
+static void testWeekWrapAround() {
+    const scheduleRule rules[] = {rule(L"0000001 22:00-06:00 1---")};
+    scheduleWheel wheel;
+    wheel.reset(rules, 1);
+    scheduleOverlay overlay;
+
+    CHECK(wheel.advance(minuteOfWeek(6, 21, 59), overlay) == 1);
+    CHECK(!overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(6, 22, 0), overlay) == 8 * 60);
+    CHECK(overlay.action(0, 2) == 1);
+    CHECK(wheel.advance(minuteOfWeek(6, 23, 59), overlay) == 6 * 60 + 1);
+    CHECK(overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(0, 0, 0), overlay) == 6 * 60);
+    CHECK(overlay.action(0, 2) == 1);
+    CHECK(wheel.advance(minuteOfWeek(0, 5, 59), overlay) == 1);
+    CHECK(overlay.active());
+    // The next transition is on Sunday again.
+    CHECK(wheel.advance(minuteOfWeek(0, 6, 0), overlay) == minuteOfWeek(6, 16, 0));
+    CHECK(!overlay.active());
+}
+
+// Both transitions of a rule within one hour of the wheel.
+static void testSameHour() {
+    const scheduleRule rules[] = {rule(L"0010000 09:10-09:40 -2--")};
+    scheduleWheel wheel;
+    wheel.reset(rules, 1);
+    scheduleOverlay overlay;
+
+    CHECK(wheel.advance(minuteOfWeek(2, 9, 0), overlay) == 10);
+    CHECK(!overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(2, 9, 10), overlay) == 30);
+    CHECK(overlay.action(1, 0) == 2);
+    CHECK(wheel.advance(minuteOfWeek(2, 9, 39), overlay) == 1);
+    CHECK(overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(2, 9, 40), overlay) == MINUTES_PER_WEEK - 30);
+    CHECK(!overlay.active());
+    // Past the last transition of the hour, wrapping around to the same hour
+    // of the next week.
+    CHECK(wheel.advance(minuteOfWeek(2, 9, 59), overlay) == MINUTES_PER_WEEK - 49);
+}
+
+// A rule ending at its start lasts a whole day, up to the same time of the
+// next day.
+static void testFullDay() {
+    const scheduleRule rules[] = {rule(L"1000000 12:00-12:00 ---0")};
+    scheduleWheel wheel;
+    wheel.reset(rules, 1);
+    scheduleOverlay overlay;
+
+    CHECK(wheel.advance(minuteOfWeek(0, 11, 59), overlay) == 1);
+    CHECK(!overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(0, 12, 0), overlay) == MINUTES_PER_DAY);
+    CHECK(overlay.action(3, 2) == 0);
+    CHECK(wheel.advance(minuteOfWeek(1, 11, 59), overlay) == 1);
+    CHECK(overlay.active());
+    CHECK(wheel.advance(minuteOfWeek(1, 12, 0), overlay) == MINUTES_PER_WEEK - MINUTES_PER_DAY);
+    CHECK(!overlay.active());
+
+    // Every day from midnight to midnight: always active, and the
+    // transitions of consecutive days coincide.
+    const scheduleRule always[] = {rule(L"1111111 00:00-24:00 3333")};
+    wheel.reset(always, 1);
+    for (int day = 0; day < 7; day++) {
+        CHECK(wheel.advance(minuteOfWeek(day, 0, 0), overlay) == MINUTES_PER_DAY);
+        CHECK(overlay.action(0, 0) == 3);
+        CHECK(wheel.advance(minuteOfWeek(day, 23, 59), overlay) == 1);
+        CHECK(overlay.action(3, 0) == 3);
+    }
+}
+
+// Later rules take precedence, slot by slot.
+static void testPrecedence() {
+    const scheduleRule rules[] = {
+        rule(L"1111111 08:00-20:00 11--"),
+        rule(L"1111111 12:00-13:00 -2-2"),
+    };
+    scheduleWheel wheel;
+    wheel.reset(rules, 2);
+    scheduleOverlay overlay;
+
+    CHECK(wheel.advance(minuteOfWeek(3, 12, 30), overlay) == 30);
+    CHECK(overlay.action(0, 0) == 1);
+    CHECK(overlay.action(1, 0) == 2);
+    CHECK(overlay.action(2, 0) == 0);
+    CHECK(overlay.action(3, 0) == 2);
+    CHECK(wheel.advance(minuteOfWeek(3, 13, 0), overlay) == 7 * 60);
+    CHECK(overlay.action(1, 0) == 1);
+    CHECK(overlay.action(3, 0) == 0);
+}
+
+int main() {
+    testParse();
+    testEmpty();
+    testWeekWrapAround();
+    testSameHour();
+    testFullDay();
+    testPrecedence();
+    return failures != 0;
+}
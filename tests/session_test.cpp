@@ -0,0 +1,102 @@
+// Tests of the session switch, simulating the instances of many sessions of
+// one machine.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. session_test.cpp ../session.cpp -o session_test
+#include <cstdlib>
+#include <vector>
+
+#include "check.h"
+#include "session.h"
+
+using namespace std;
+
+// Other WM_WTSSESSION_CHANGE events, which do not move the console.
+static const unsigned WTS_REMOTE_CONNECT = 0x3;
+static const unsigned WTS_SESSION_LOCK = 0x7;
+static const unsigned WTS_SESSION_UNLOCK = 0x8;
+
+static const int SESSIONS = 48;
+
+// Per-session cost of the instance state, beyond the process itself.
+static const size_t SESSION_STATE_BUDGET = 16;
+
+static int activeCount(const vector<sessionSwitch>& sessions) {
+    int count = 0;
+    for (const auto& session : sessions) {
+        count += session.active();
+    }
+    return count;
+}
+
+static void testSingleSession() {
+    sessionSwitch session(true);
+    CHECK(session.active());
+    CHECK(session.update(SESSION_CONSOLE_CONNECT) == SESSION_UNCHANGED);
+    CHECK(session.update(WTS_SESSION_LOCK) == SESSION_UNCHANGED);
+    CHECK(session.update(SESSION_CONSOLE_DISCONNECT) == SESSION_DORMANT);
+    CHECK(!session.active());
+    // Repeated: nothing to do.
+    CHECK(session.update(SESSION_CONSOLE_DISCONNECT) == SESSION_UNCHANGED);
+    CHECK(session.update(WTS_REMOTE_CONNECT) == SESSION_UNCHANGED);
+    CHECK(!session.active());
+    CHECK(session.update(SESSION_CONSOLE_CONNECT) == SESSION_ACTIVATED);
+    CHECK(session.active());
+    CHECK(session.activationCount() == 1);
+}
+
+// The console moves between sessions as with fast user switching: the session
+// losing it gets WTS_CONSOLE_DISCONNECT, then the one getting it
+// WTS_CONSOLE_CONNECT. Exactly one instance applies once both are processed,
+// and the others never do anything.
+static void testManySessions() {
+    CHECK(sizeof(sessionSwitch) <= SESSION_STATE_BUDGET);
+    vector<sessionSwitch> sessions;
+    for (int i = 0; i < SESSIONS; i++) {
+        sessions.emplace_back(i == 0);
+    }
+    int console = 0;
+    vector<unsigned> activations(SESSIONS, 0);
+    srand(1);
+    for (int round = 0; round < 1000; round++) {
+        const int next = rand() % SESSIONS;
+        // Unrelated events of sessions not involved in the switch.
+        const int other = rand() % SESSIONS;
+        if (other != console && other != next) {
+            CHECK(sessions[other].update(rand() % 2 ? WTS_SESSION_LOCK : WTS_SESSION_UNLOCK) == SESSION_UNCHANGED);
+            CHECK(sessions[other].update(WTS_REMOTE_CONNECT) == SESSION_UNCHANGED);
+        }
+        if (next == console) {
+            // Reconnecting the same session: no transition.
+            CHECK(sessions[console].update(SESSION_CONSOLE_CONNECT) == SESSION_UNCHANGED);
+            continue;
+        }
+        CHECK(sessions[console].update(SESSION_CONSOLE_DISCONNECT) == SESSION_DORMANT);
+        CHECK(activeCount(sessions) == 0);
+        CHECK(sessions[next].update(SESSION_CONSOLE_CONNECT) == SESSION_ACTIVATED);
+        activations[next]++;
+        console = next;
+        CHECK(activeCount(sessions) == 1);
+        CHECK(sessions[console].active());
+    }
+    for (int i = 0; i < SESSIONS; i++) {
+        CHECK(sessions[i].activationCount() == activations[i]);
+    }
+}
+
+// An instance started in a session not attached to the console, like a
+// remote desktop session, stays dormant until the session gets the console.
+static void testStartedDormant() {
+    sessionSwitch session(false);
+    CHECK(!session.active());
+    CHECK(session.update(SESSION_CONSOLE_CONNECT) == SESSION_ACTIVATED);
+    CHECK(session.update(SESSION_CONSOLE_DISCONNECT) == SESSION_DORMANT);
+    CHECK(session.activationCount() == 1);
+}
+
+int main() {
+    testSingleSession();
+    testManySessions();
+    testStartedDormant();
+    return failures != 0;
+}
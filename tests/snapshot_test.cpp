@@ -0,0 +1,73 @@
+// Stress test of snapshot: readers load while writers update, and every
+// snapshot must be internally consistent.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -pthread -I.. snapshot_test.cpp -o snapshot_test
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// All fields hold the same count in a consistent snapshot.
+struct counters {
+    uint64_t values[16] = {0};
+};
+
+static const int READERS = 8;
+static const int WRITERS = 2;
+static const int UPDATES = 20000;
+
+int main() {
+    snapshot<counters> state;
+    atomic<int> writersDone(0);
+    atomic<int> inconsistent(0);
+    atomic<int> backwards(0);
+
+    vector<thread> threads;
+    for (int i = 0; i < READERS; i++) {
+        threads.emplace_back([&] {
+            uint64_t last = 0;
+            while (writersDone.load() < WRITERS) {
+                const auto s = state.load();
+                const uint64_t count = s->values[0];
+                for (const auto value : s->values) {
+                    if (value != count) {
+                        inconsistent++;
+                        break;
+                    }
+                }
+                // Updates are published in order.
+                if (count < last) {
+                    backwards++;
+                }
+                last = count;
+            }
+        });
+    }
+    for (int i = 0; i < WRITERS; i++) {
+        threads.emplace_back([&] {
+            for (int n = 0; n < UPDATES; n++) {
+                state.update([](counters& c) {
+                    for (auto& value : c.values) {
+                        value++;
+                    }
+                });
+            }
+            writersDone++;
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    CHECK(inconsistent.load() == 0);
+    CHECK(backwards.load() == 0);
+    // Concurrent updates are retried, never lost.
+    CHECK(state.load()->values[0] == (uint64_t)WRITERS * UPDATES);
+    return failures != 0;
+}
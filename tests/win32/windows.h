@@ -0,0 +1,53 @@
+#pragma once
+// The part of windows.h used by deadline.cpp, for testing it on Linux. The
+// window timer is recorded in fakeTimer() instead of being set.
+#include <cstdint>
+
+typedef unsigned int UINT;
+typedef unsigned long DWORD;
+typedef uintptr_t UINT_PTR;
+typedef unsigned long long ULONGLONG;
+typedef int BOOL;
+typedef struct fakeWindow* HWND;
+typedef void (*TIMERPROC)(HWND, UINT, UINT_PTR, DWORD);
+
+#define WINAPI
+#define ERROR_SUCCESS 0L
+#define USER_TIMER_MINIMUM 0x0000000A
+#define USER_TIMER_MAXIMUM 0x7FFFFFFF
+#define TIMERV_DEFAULT_COALESCING 0
+
+struct fakeWindowTimer {
+    bool set = false;
+    UINT_PTR id = 0;
+    UINT elapse = 0;
+    // Number of SetCoalescableTimer calls.
+    int sets = 0;
+};
+
+// One instance shared by all translation units.
+inline fakeWindowTimer& fakeTimer() {
+    static fakeWindowTimer timer;
+    return timer;
+}
+
+inline ULONGLONG GetTickCount64() {
+    return 0;
+}
+
+inline DWORD GetLastError() {
+    return ERROR_SUCCESS;
+}
+
+inline UINT_PTR SetCoalescableTimer(HWND, UINT_PTR id, UINT elapse, TIMERPROC, unsigned long) {
+    fakeTimer().set = true;
+    fakeTimer().id = id;
+    fakeTimer().elapse = elapse;
+    fakeTimer().sets++;
+    return id;
+}
+
+inline BOOL KillTimer(HWND, UINT_PTR) {
+    fakeTimer().set = false;
+    return 1;
+}
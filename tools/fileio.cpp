@@ -0,0 +1,42 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "fileio.h"
+
+using namespace std;
+
+bool readFile(const char* path, string& content) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        return false;
+    }
+    content.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+bool writeFileAtomically(const char* path, const string& content) {
+    const string temp = string(path) + ".tmp";
+    {
+        ofstream out(temp, ios::binary | ios::trunc);
+        if (!out.write(content.data(), content.size()) || !out.flush()) {
+            return false;
+        }
+    }
+#ifdef _WIN32
+    if (!MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        remove(temp.c_str());
+        return false;
+    }
+#else
+    if (rename(temp.c_str(), path) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+#endif
+    return true;
+}
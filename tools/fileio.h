@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+// File helpers shared by the build tools.
+
+// Read the whole file at path into content.
+bool readFile(const char* path, std::string& content);
+// Write content to a temporary file and rename it to path, so that readers
+// see either the old or the new file, and an interrupted write never leaves
+// a truncated one.
+bool writeFileAtomically(const char* path, const std::string& content);
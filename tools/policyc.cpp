@@ -0,0 +1,173 @@
+// Compiler, validator and decompiler of Sleepy Lid policy bundles.
+//
+//   policyc compile <policy.txt> <SleepyLid.policy>
+//   policyc check <SleepyLid.policy>
+//   policyc decompile <SleepyLid.policy>
+//
+// The text format is one setting per line, # starts a comment:
+//
+//   SyncMonitor=1
+//   MonitorActions=0022
+//   LowBatteryPercent=10
+//   LowBatteryAction=2
+//   Rule=1111111 22:00-06:00 2222
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 -I.. policyc.cpp fileio.cpp ../policy.cpp ../schedule.cpp -o policyc
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+#include "policy.h"
+
+using namespace std;
+
+static wstring widen(const string& str) {
+    // The format is ASCII only.
+    return wstring(str.begin(), str.end());
+}
+
+static string narrow(const wstring& str) {
+    return string(str.begin(), str.end());
+}
+
+static string trim(const string& str) {
+    const auto begin = str.find_first_not_of(" \t\r");
+    if (begin == string::npos) {
+        return "";
+    }
+    const auto end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+static int compile(const char* in, const char* out) {
+    string text;
+    if (!readFile(in, text)) {
+        cerr << in << ": cannot read" << endl;
+        return 1;
+    }
+    policyHeader header = {0};
+    header.magic = POLICY_MAGIC;
+    header.version = POLICY_VERSION;
+    header.headerSize = sizeof header;
+    header.lowBatteryAction = 2;  // Hibernate, as in SleepyLid.ini.
+    vector<scheduleRule> rules;
+
+    istringstream lines(text);
+    string line;
+    for (int n = 1; getline(lines, line); n++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        const auto sep = line.find('=');
+        const string key = trim(line.substr(0, sep));
+        const string value = sep == string::npos ? "" : trim(line.substr(sep + 1));
+        bool ok = false;
+        if (key == "SyncMonitor") {
+            ok = value == "0" || value == "1";
+            header.syncMonitor = value == "1";
+        } else if (key == "MonitorActions") {
+            ok = value.size() == 4;
+            for (size_t i = 0; ok && i < 4; i++) {
+                ok = value[i] >= '0' && value[i] <= '3';
+                header.actions[i] = (uint8_t)(value[i] - '0');
+            }
+        } else if (key == "LowBatteryPercent") {
+            ok = !value.empty() && value.size() <= 3 && value.find_first_not_of("0123456789") == string::npos &&
+                 stoi(value) <= 100;
+            header.lowBatteryPercent = ok ? (uint8_t)stoi(value) : 0;
+        } else if (key == "LowBatteryAction") {
+            ok = value.size() == 1 && value[0] >= '0' && value[0] <= '3';
+            header.lowBatteryAction = (uint8_t)(value[0] - '0');
+        } else if (key == "Rule") {
+            scheduleRule rule;
+            ok = parseScheduleRule(widen(value), rule);
+            rules.push_back(rule);
+        }
+        if (!ok) {
+            cerr << in << ":" << n << ": invalid line: " << line << endl;
+            return 1;
+        }
+    }
+    header.ruleCount = (uint32_t)rules.size();
+
+    string bundle((const char*)&header, sizeof header);
+    bundle.append((const char*)rules.data(), rules.size() * sizeof(scheduleRule));
+    // The checksum covers the header too, so it is computed on the bundle.
+    header.checksum = policyBundleChecksum((const policyHeader*)bundle.data());
+    bundle.replace(0, sizeof header, (const char*)&header, sizeof header);
+    if (validatePolicy(bundle.data(), bundle.size()) == NULL) {
+        cerr << in << ": internal error: invalid bundle" << endl;
+        return 1;
+    }
+    if (!writeFileAtomically(out, bundle)) {
+        cerr << out << ": cannot write" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+static const policyHeader* load(const char* path, string& content) {
+    if (!readFile(path, content)) {
+        cerr << path << ": cannot read" << endl;
+        return NULL;
+    }
+    const auto header = validatePolicy(content.data(), content.size());
+    if (header == NULL) {
+        cerr << path << ": invalid policy bundle" << endl;
+    }
+    return header;
+}
+
+static int check(const char* path) {
+    string content;
+    const auto header = load(path, content);
+    if (header == NULL) {
+        return 1;
+    }
+    cout << path << ": version " << header->version << ", "
+         << header->ruleCount << " rules, OK" << endl;
+    return 0;
+}
+
+static int decompile(const char* path) {
+    string content;
+    const auto header = load(path, content);
+    if (header == NULL) {
+        return 1;
+    }
+    cout << "SyncMonitor=" << (int)header->syncMonitor << endl;
+    cout << "MonitorActions=";
+    for (const auto action : header->actions) {
+        cout << (int)action;
+    }
+    cout << endl;
+    cout << "LowBatteryPercent=" << (int)header->lowBatteryPercent << endl;
+    cout << "LowBatteryAction=" << (int)header->lowBatteryAction << endl;
+    const auto rules = policyRules(header);
+    for (uint32_t i = 0; i < header->ruleCount; i++) {
+        cout << "Rule=" << narrow(scheduleRuleToString(rules[i])) << endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && strcmp(argv[1], "compile") == 0) {
+        return compile(argv[2], argv[3]);
+    }
+    if (argc == 3 && strcmp(argv[1], "check") == 0) {
+        return check(argv[2]);
+    }
+    if (argc == 3 && strcmp(argv[1], "decompile") == 0) {
+        return decompile(argv[2]);
+    }
+    cerr << "usage: policyc compile <policy.txt> <SleepyLid.policy>" << endl
+         << "       policyc check <SleepyLid.policy>" << endl
+         << "       policyc decompile <SleepyLid.policy>" << endl;
+    return 2;
+}
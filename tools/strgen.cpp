@@ -0,0 +1,272 @@
+// Generator of the Sleepy Lid string tables.
+//
+//   strgen <res.h> <strtab.h> <locale>=<str.rc>...
+//
+// Reads the STR_* ids of res.h and the STRINGTABLE of each rc file, and
+// writes a header of index-addressed arrays, one row per locale:
+//
+//   STRINGS_U16[locale][id - STRING_BASE]  UTF-16, char16_t on any platform
+//
+// The first locale is the default. Strings missing in other locales are
+// taken from it. The output is ASCII only, non-ASCII characters are escaped.
+//
+// Portable, build on Linux with:
+//   g++ -std=c++14 strgen.cpp fileio.cpp -o strgen
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+using namespace std;
+
+static bool isIdentifierChar(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Read the identifier at pos, and move pos past it.
+static string identifier(const string& line, size_t& pos) {
+    const size_t begin = pos;
+    while (pos < line.size() && isIdentifierChar(line[pos])) {
+        pos++;
+    }
+    return line.substr(begin, pos - begin);
+}
+
+static void skipSpaces(const string& line, size_t& pos) {
+    while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r')) {
+        pos++;
+    }
+}
+
+// Read the ids "#define STR_XXX 200" of res.h in order.
+static bool readIds(const char* path, vector<pair<string, int>>& ids) {
+    string text;
+    if (!readFile(path, text)) {
+        cerr << path << ": cannot read" << endl;
+        return false;
+    }
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)) {
+        size_t pos = 0;
+        skipSpaces(line, pos);
+        if (line.compare(pos, 7, "#define") != 0) {
+            continue;
+        }
+        pos += 7;
+        skipSpaces(line, pos);
+        const string name = identifier(line, pos);
+        if (name.compare(0, 4, "STR_") != 0) {
+            continue;
+        }
+        skipSpaces(line, pos);
+        ids.push_back(make_pair(name, atoi(line.c_str() + pos)));
+    }
+    for (size_t i = 1; i < ids.size(); i++) {
+        if (ids[i].second != ids[0].second + (int)i) {
+            cerr << path << ": " << ids[i].first << " is not contiguous" << endl;
+            return false;
+        }
+    }
+    if (ids.empty()) {
+        cerr << path << ": no STR_ ids" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Read the quoted string at pos, L"..." or "...", decoding the escapes.
+static bool quoted(const string& line, size_t& pos, string& value) {
+    if (pos < line.size() && line[pos] == 'L') {
+        pos++;
+    }
+    if (pos >= line.size() || line[pos] != '"') {
+        return false;
+    }
+    for (pos++; pos < line.size(); pos++) {
+        char c = line[pos];
+        if (c == '"') {
+            // "" is a quote in rc files.
+            if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                value += '"';
+                pos++;
+                continue;
+            }
+            pos++;
+            return true;
+        }
+        if (c == '\\' && pos + 1 < line.size()) {
+            c = line[++pos];
+            switch (c) {
+            case 'n':
+                c = '\n';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            }
+        }
+        value += c;
+    }
+    return false;
+}
+
+// Read the "STR_XXX "text"" lines of the STRINGTABLE of an rc file.
+static bool readStrings(const char* path, map<string, string>& strings) {
+    string text;
+    if (!readFile(path, text)) {
+        cerr << path << ": cannot read" << endl;
+        return false;
+    }
+    // UTF-8 BOM.
+    if (text.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        text.erase(0, 3);
+    }
+    istringstream lines(text);
+    string line;
+    for (int n = 1; getline(lines, line); n++) {
+        size_t pos = 0;
+        skipSpaces(line, pos);
+        if (line.compare(pos, 4, "STR_") != 0) {
+            continue;
+        }
+        const string name = identifier(line, pos);
+        skipSpaces(line, pos);
+        string value;
+        if (!quoted(line, pos, value)) {
+            cerr << path << ":" << n << ": invalid string: " << line << endl;
+            return false;
+        }
+        strings[name] = value;
+    }
+    return true;
+}
+
+// Decode UTF-8 to code points.
+static bool decodeUtf8(const string& str, vector<unsigned>& codePoints) {
+    for (size_t i = 0; i < str.size();) {
+        const unsigned char c = str[i];
+        const int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (length == 0 || i + length > str.size()) {
+            return false;
+        }
+        unsigned codePoint = length == 1 ? c : c & (0x7F >> length);
+        for (int k = 1; k < length; k++) {
+            const unsigned char next = str[i + k];
+            if ((next >> 6) != 0x2) {
+                return false;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        codePoints.push_back(codePoint);
+        i += length;
+    }
+    return true;
+}
+
+static void appendEscaped(string& out, unsigned c) {
+    char buf[16];
+    if (c == '"' || c == '\\') {
+        out += '\\';
+        out += (char)c;
+    } else if (c == '\n') {
+        out += "\\n";
+    } else if (c == '\t') {
+        out += "\\t";
+    } else {
+        snprintf(buf, sizeof buf, "\\%03o", c);
+        out += buf;
+    }
+}
+
+// C literal of str, u"..." with universal character names for non-ASCII.
+// Those above U+FFFF become surrogate pairs.
+static string u16Literal(const vector<unsigned>& codePoints) {
+    string out = "u\"";
+    char buf[16];
+    for (const auto c : codePoints) {
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+            out += (char)c;
+        } else if (c < 0x80) {
+            appendEscaped(out, c);
+        } else {
+            snprintf(buf, sizeof buf, c <= 0xFFFF ? "\\u%04X" : "\\U%08X", c);
+            out += buf;
+        }
+    }
+    return out + "\"";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "usage: strgen <res.h> <strtab.h> <locale>=<str.rc>..." << endl;
+        return 1;
+    }
+    vector<pair<string, int>> ids;
+    if (!readIds(argv[1], ids)) {
+        return 1;
+    }
+    vector<string> locales;
+    vector<map<string, string>> tables;
+    for (int i = 3; i < argc; i++) {
+        const char* sep = strchr(argv[i], '=');
+        if (sep == NULL || sep == argv[i]) {
+            cerr << argv[i] << ": expected <locale>=<str.rc>" << endl;
+            return 1;
+        }
+        locales.push_back(string(argv[i], sep - argv[i]));
+        tables.push_back(map<string, string>());
+        if (!readStrings(sep + 1, tables.back())) {
+            return 1;
+        }
+    }
+
+    ostringstream u16;
+    for (size_t locale = 0; locale < locales.size(); locale++) {
+        u16 << "    {\n";
+        for (const auto& id : ids) {
+            auto found = tables[locale].find(id.first);
+            if (found == tables[locale].end()) {
+                found = tables[0].find(id.first);
+                if (found == tables[0].end()) {
+                    cerr << argv[3] << ": " << id.first << " is missing" << endl;
+                    return 1;
+                }
+                cerr << "strgen: warning: " << id.first << " of " << locales[locale] << " is missing" << endl;
+            }
+            vector<unsigned> codePoints;
+            if (!decodeUtf8(found->second, codePoints)) {
+                cerr << "strgen: " << id.first << " of " << locales[locale] << " is not UTF-8" << endl;
+                return 1;
+            }
+            u16 << "        " << u16Literal(codePoints) << ",  // " << id.first << "\n";
+        }
+        u16 << "    },\n";
+    }
+
+    ostringstream out;
+    out << "// Generated by tools/strgen. Do not edit.\n"
+        << "#pragma once\n\n"
+        << "enum { STRING_BASE = " << ids[0].second
+        << ", STRING_COUNT = " << ids.size()
+        << ", LOCALE_COUNT = " << locales.size() << " };\n\n"
+        << "// Locale names. The first one is the default.\n"
+        << "static const wchar_t *const LOCALE_NAMES[LOCALE_COUNT] = {";
+    for (size_t locale = 0; locale < locales.size(); locale++) {
+        out << (locale == 0 ? "" : ", ") << "L\"" << locales[locale] << "\"";
+    }
+    out << "};\n\n"
+        << "static const char16_t *const STRINGS_U16[LOCALE_COUNT][STRING_COUNT] = {\n"
+        << u16.str() << "};\n";
+    if (!writeFileAtomically(argv[2], out.str())) {
+        cerr << argv[2] << ": cannot write" << endl;
+        return 1;
+    }
+    return 0;
+}